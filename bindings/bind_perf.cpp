@@ -1,19 +1,166 @@
 #include <pybind11/numpy.h>
 #include <pybind11/pybind11.h>
 
+#include "batched_env.hpp"
+#include "eval_cache.hpp"
 #include "game_env.hpp"
+#include "mcts.hpp"
+#include "parallel_mcts.hpp"
+#include "playout.hpp"
 
 namespace py = pybind11;
 
+// the buffer has to be writeable, contiguous and hold exactly size elements
+void checkBuffer(const py::array &arr, py::ssize_t size, const char *name) {
+    if (!(arr.flags() & py::array::c_style) || !arr.writeable()) {
+        throw std::runtime_error(std::string("Error: ") + name +
+                                 " has to be writeable and contiguous.");
+    }
+    if (arr.size() != size) {
+        throw std::runtime_error(std::string("Error: ") + name + " has " +
+                                 std::to_string(arr.size()) +
+                                 " elements but needs " +
+                                 std::to_string(size) + ".");
+    }
+}
+
+uint8_t *getByteBuffer(py::array &arr, py::ssize_t size, const char *name) {
+    const py::dtype dtype = arr.dtype();
+    if (dtype.itemsize() != 1 || (dtype.kind() != 'b' && dtype.kind() != 'u')) {
+        throw std::runtime_error(std::string("Error: ") + name +
+                                 " has to be a bool or uint8 array.");
+    }
+    checkBuffer(arr, size, name);
+    return static_cast<uint8_t *>(arr.mutable_data());
+}
+
+Bitboard *getPlaneBuffer(py::array &arr, py::ssize_t size, const char *name) {
+    const py::dtype dtype = arr.dtype();
+    if (dtype.itemsize() != 8 || dtype.kind() != 'u') {
+        throw std::runtime_error(std::string("Error: ") + name +
+                                 " has to be a uint64 array.");
+    }
+    checkBuffer(arr, size, name);
+    return static_cast<Bitboard *>(arr.mutable_data());
+}
+
+int32_t *getRewardBuffer(py::array &arr, py::ssize_t size, const char *name) {
+    const py::dtype dtype = arr.dtype();
+    if (dtype.itemsize() != 4 || dtype.kind() != 'i') {
+        throw std::runtime_error(std::string("Error: ") + name +
+                                 " has to be an int32 array.");
+    }
+    checkBuffer(arr, size, name);
+    return static_cast<int32_t *>(arr.mutable_data());
+}
+
+// evaluate gets obs (B, 7104) and masks (B, 4672) as read only uint8 views
+// into the buffers of the search, they are overwritten by the next round. it
+// returns priors (B, 4672) and values (B,) for the player to move. the search
+// calls it without the GIL
+constexpr const char *SEARCH_DOC =
+    "Runs the simulations of a search.\n\n"
+    "evaluate(obs, masks) gets uint8 arrays of shape (B, 7104) and\n"
+    "(B, 4672) and returns priors of shape (B, 4672) and values of shape\n"
+    "(B,) for the player to move. obs and masks are read only views into\n"
+    "buffers that the search overwrites after evaluate returns, use\n"
+    "obs.copy() to keep them, for example for a replay buffer.";
+
+MctsEvaluator wrapEvaluator(const py::function &evaluate) {
+    return [&evaluate](size_t batchSize, const uint8_t *observations,
+                       const uint8_t *masks, float *priors, float *values) {
+        py::gil_scoped_acquire acquire;
+        const py::ssize_t n = batchSize;
+        // views into the buffers of the search, no copy
+        const py::capsule noOwner(observations, [](void *) {});
+        const py::array_t<uint8_t> obsArray(
+            std::vector<py::ssize_t>{n, OBSERVATION_SPACE_SIZE}, observations,
+            noOwner);
+        const py::array_t<uint8_t> maskArray(
+            std::vector<py::ssize_t>{n, ACTION_SPACE_SIZE}, masks, noOwner);
+        // a caller that keeps them has to copy them, writing fails loudly
+        obsArray.attr("setflags")(py::arg("write") = false);
+        maskArray.attr("setflags")(py::arg("write") = false);
+
+        const py::tuple result = evaluate(obsArray, maskArray);
+        if (result.size() != 2) {
+            throw std::runtime_error(
+                "Error: evaluate has to return priors and values.");
+        }
+        using FloatArray =
+            py::array_t<float, py::array::c_style | py::array::forcecast>;
+        const FloatArray priorArray = result[0].cast<FloatArray>();
+        const FloatArray valueArray = result[1].cast<FloatArray>();
+        if (priorArray.size() != n * ACTION_SPACE_SIZE ||
+            valueArray.size() != n) {
+            throw std::runtime_error(
+                "Error: evaluate returned priors or values of the wrong "
+                "size.");
+        }
+        std::copy_n(priorArray.data(), n * ACTION_SPACE_SIZE, priors);
+        std::copy_n(valueArray.data(), n, values);
+    };
+}
+
+// runs f without holding the GIL, everything f needs from python objects has
+// to be taken out of them before
+template <typename F>
+auto withoutGil(F &&f) {
+    py::gil_scoped_release release;
+    return f();
+}
+
+// the engine work of every method runs without the GIL, the lookup tables
+// are read only so independent games can be played from several python
+// threads. a single env must still only be used by one thread at a time
 PYBIND11_MODULE(chess_env, m) {
     py::class_<ChessGameEnv> chess_env(m, "ChessGameEnv");
 
     chess_env.def(py::init<>());
 
-    chess_env.def("step", &ChessGameEnv::step, py::arg("action"));
-    chess_env.def("observe", &ChessGameEnv::observe);
-    chess_env.def("copy",
-                  [](const ChessGameEnv &env) { return ChessGameEnv(env); });
+    chess_env.def("step", &ChessGameEnv::step, py::arg("action"),
+                  py::call_guard<py::gil_scoped_release>());
+    chess_env.def("push", &ChessGameEnv::push, py::arg("action"),
+                  py::call_guard<py::gil_scoped_release>());
+    chess_env.def("pop", &ChessGameEnv::pop,
+                  py::call_guard<py::gil_scoped_release>());
+    chess_env.def("observe", &ChessGameEnv::observe,
+                  py::call_guard<py::gil_scoped_release>());
+    chess_env.def(
+        "observe_into",
+        [](const ChessGameEnv &env, py::array obs, py::array mask) {
+            uint8_t *obsData =
+                getByteBuffer(obs, OBSERVATION_SPACE_SIZE, "obs_out");
+            uint8_t *maskData =
+                getByteBuffer(mask, ACTION_SPACE_SIZE, "mask_out");
+            const TerminationInfo term = withoutGil(
+                [&] { return env.observeInto(obsData, maskData); });
+            return py::make_tuple(term.whiteReward, term.blackReward,
+                                  term.isTerminated);
+        },
+        py::arg("obs_out"), py::arg("mask_out"));
+    chess_env.def("observe_planes", [](const ChessGameEnv &env) {
+        py::array_t<uint64_t> planes(NUM_OBSERVATION_PLANES);
+        Bitboard *planeData = planes.mutable_data();
+        withoutGil([&] { env.observePlanes(planeData); });
+        return planes;
+    });
+    chess_env.def(
+        "observe_planes_into",
+        [](const ChessGameEnv &env, py::array planes, py::array mask) {
+            Bitboard *planeData =
+                getPlaneBuffer(planes, NUM_OBSERVATION_PLANES, "planes_out");
+            uint8_t *maskData =
+                getByteBuffer(mask, ACTION_SPACE_SIZE, "mask_out");
+            const TerminationInfo term = withoutGil(
+                [&] { return env.observePlanesInto(planeData, maskData); });
+            return py::make_tuple(term.whiteReward, term.blackReward,
+                                  term.isTerminated);
+        },
+        py::arg("planes_out"), py::arg("mask_out"));
+    chess_env.def(
+        "copy", [](const ChessGameEnv &env) { return ChessGameEnv(env); },
+        py::call_guard<py::gil_scoped_release>());
     chess_env.def("showBoard", &ChessGameEnv::showBoard);
 
     py::class_<ChessObservation> chess_observation(m, "ChessObservation");
@@ -40,4 +187,236 @@ PYBIND11_MODULE(chess_env, m) {
                       arr.mutable_data());
             return arr;
         });
+
+    py::class_<BatchedChessEnv> batched_env(m, "BatchedChessEnv");
+
+    batched_env.def(py::init<size_t, size_t, bool>(), py::arg("num_envs"),
+                    py::arg("num_threads") = 1, py::arg("pin_threads") = false);
+    batched_env.def("__len__", &BatchedChessEnv::size);
+    batched_env.def("reset", py::overload_cast<>(&BatchedChessEnv::reset));
+    batched_env.def("reset",
+                    py::overload_cast<size_t>(&BatchedChessEnv::reset),
+                    py::arg("index"));
+    batched_env.def(
+        "step",
+        [](BatchedChessEnv &env,
+           py::array_t<Action, py::array::c_style | py::array::forcecast>
+               actions) {
+            if (actions.size() != static_cast<py::ssize_t>(env.size())) {
+                throw std::runtime_error(
+                    "Error: step needs one action per game.");
+            }
+            const Action *actionData = actions.data();
+            py::gil_scoped_release release;
+            env.step(actionData);
+        },
+        py::arg("actions"));
+    batched_env.def(
+        "observe_into",
+        [](const BatchedChessEnv &env, py::array obs, py::array mask,
+           py::array rewards, py::array done) {
+            const py::ssize_t n = env.size();
+            uint8_t *obsData =
+                getByteBuffer(obs, n * OBSERVATION_SPACE_SIZE, "obs_out");
+            uint8_t *maskData =
+                getByteBuffer(mask, n * ACTION_SPACE_SIZE, "mask_out");
+            int32_t *rewardData =
+                getRewardBuffer(rewards, n * 2, "rewards_out");
+            uint8_t *doneData = getByteBuffer(done, n, "done_out");
+            py::gil_scoped_release release;
+            env.observeInto(obsData, maskData, rewardData, doneData);
+        },
+        py::arg("obs_out"), py::arg("mask_out"), py::arg("rewards_out"),
+        py::arg("done_out"));
+    batched_env.def(
+        "observe_planes_into",
+        [](const BatchedChessEnv &env, py::array planes, py::array mask,
+           py::array rewards, py::array done) {
+            const py::ssize_t n = env.size();
+            Bitboard *planeData = getPlaneBuffer(
+                planes, n * NUM_OBSERVATION_PLANES, "planes_out");
+            uint8_t *maskData =
+                getByteBuffer(mask, n * ACTION_SPACE_SIZE, "mask_out");
+            int32_t *rewardData =
+                getRewardBuffer(rewards, n * 2, "rewards_out");
+            uint8_t *doneData = getByteBuffer(done, n, "done_out");
+            py::gil_scoped_release release;
+            env.observePlanesInto(planeData, maskData, rewardData, doneData);
+        },
+        py::arg("planes_out"), py::arg("mask_out"), py::arg("rewards_out"),
+        py::arg("done_out"));
+    batched_env.def(
+        "get_env",
+        [](const BatchedChessEnv &env, size_t index) {
+            if (index >= env.size()) {
+                throw py::index_error("Error: there is no game with index " +
+                                      std::to_string(index) + ".");
+            }
+            return ChessGameEnv(env[index]);
+        },
+        py::arg("index"));
+    batched_env.def(
+        "random_self_play",
+        [](BatchedChessEnv &env, uint64_t seed, size_t numSteps) {
+            return withoutGil(
+                [&] { return env.playRandomSteps(seed, numSteps); });
+        },
+        py::arg("seed"), py::arg("num_steps"));
+
+    m.def(
+        "playouts",
+        [](size_t numGames, uint64_t seed, uint32_t maxPlies,
+           const std::string &fen, size_t numThreads, bool returnActions) {
+            const GameState start = fen.empty() ? GameState() : parseFen(fen);
+            py::array_t<int32_t> rewards(
+                std::vector<py::ssize_t>{py::ssize_t(numGames), 2});
+            py::array_t<uint32_t> plies(numGames);
+            py::array_t<bool> terminated(numGames);
+            std::vector<PlayoutResult> results(numGames);
+            std::vector<std::vector<Action>> actions;
+
+            withoutGil([&] {
+                std::unique_ptr<ThreadPool> pool;
+                if (numThreads > 1) {
+                    pool = std::make_unique<ThreadPool>(numThreads);
+                }
+                playoutBatch(start, seed, numGames, maxPlies, results.data(),
+                             returnActions ? &actions : nullptr, pool.get());
+            });
+
+            auto rewardData = rewards.mutable_unchecked<2>();
+            auto pliesData = plies.mutable_unchecked<1>();
+            auto terminatedData = terminated.mutable_unchecked<1>();
+            for (size_t i = 0; i < numGames; i++) {
+                rewardData(i, 0) = results[i].whiteReward;
+                rewardData(i, 1) = results[i].blackReward;
+                pliesData(i) = results[i].plies;
+                terminatedData(i) = results[i].isTerminated;
+            }
+            if (!returnActions) {
+                return py::make_tuple(rewards, plies, terminated);
+            }
+            py::list actionLists;
+            for (const std::vector<Action> &gameActions : actions) {
+                py::array_t<Action> arr(gameActions.size());
+                std::copy(gameActions.begin(), gameActions.end(),
+                          arr.mutable_data());
+                actionLists.append(arr);
+            }
+            return py::make_tuple(rewards, plies, terminated, actionLists);
+        },
+        py::arg("num_games"), py::arg("seed") = 0,
+        py::arg("max_plies") = 2 * MAX_GAME_LENGTH, py::arg("fen") = "",
+        py::arg("num_threads") = 1, py::arg("return_actions") = false);
+
+    py::class_<EvalCache> evalCache(m, "EvalCache");
+
+    evalCache.def(py::init<size_t, size_t>(), py::arg("capacity"),
+                  py::arg("num_shards") = 64);
+    evalCache.def("__len__", &EvalCache::size);
+    evalCache.def_property_readonly("capacity", &EvalCache::getCapacity);
+    evalCache.def_property_readonly("hits", &EvalCache::getHits);
+    evalCache.def_property_readonly("misses", &EvalCache::getMisses);
+    evalCache.def("clear", &EvalCache::clear);
+
+    py::class_<BatchedMcts> mcts(m, "MCTS");
+
+    mcts.def(py::init([](size_t numGames, uint32_t numSimulations,
+                         uint32_t leavesPerRound, float cPuct,
+                         float dirichletAlpha, float dirichletEpsilon,
+                         float virtualLoss, uint64_t seed,
+                         bool useTranspositions) {
+                 MctsConfig config;
+                 config.numSimulations = numSimulations;
+                 config.leavesPerRound = leavesPerRound;
+                 config.cPuct = cPuct;
+                 config.dirichletAlpha = dirichletAlpha;
+                 config.dirichletEpsilon = dirichletEpsilon;
+                 config.virtualLoss = virtualLoss;
+                 config.useTranspositions = useTranspositions;
+                 return BatchedMcts(numGames, config, seed);
+             }),
+             py::arg("num_games"), py::arg("num_simulations") = 800,
+             py::arg("leaves_per_round") = 8, py::arg("c_puct") = 1.25f,
+             py::arg("dirichlet_alpha") = 0.3f,
+             py::arg("dirichlet_epsilon") = 0.25f,
+             py::arg("virtual_loss") = 1.0f, py::arg("seed") = 0,
+             py::arg("use_transpositions") = false);
+    mcts.def("__len__", &BatchedMcts::size);
+    mcts.def(
+        "reset",
+        [](BatchedMcts &self, size_t game, const ChessGameEnv &env) {
+            self.reset(game, env.getState());
+        },
+        py::arg("game"), py::arg("env"));
+    mcts.def(
+        "reset",
+        [](BatchedMcts &self, size_t game) { self.reset(game, GameState()); },
+        py::arg("game"));
+    mcts.def("advance", &BatchedMcts::advance, py::arg("game"),
+             py::arg("action"), py::call_guard<py::gil_scoped_release>());
+    mcts.def(
+        "search",
+        [](BatchedMcts &self, py::function evaluate) {
+            const MctsEvaluator evaluator = wrapEvaluator(evaluate);
+            withoutGil([&] { self.search(evaluator); });
+        },
+        py::arg("evaluate"), SEARCH_DOC);
+    mcts.def(
+        "visit_counts",
+        [](const BatchedMcts &self, size_t game) {
+            py::array_t<float> counts(ACTION_SPACE_SIZE);
+            self.getVisitCounts(game, counts.mutable_data());
+            return counts;
+        },
+        py::arg("game"));
+    mcts.def("root_value", &BatchedMcts::getRootValue, py::arg("game"));
+    mcts.def("table_size", &BatchedMcts::getTableSize, py::arg("game"));
+    // the cache is kept alive by the search, None turns it off
+    mcts.def("set_eval_cache", &BatchedMcts::setEvalCache, py::arg("cache"),
+             py::keep_alive<1, 2>());
+
+    py::class_<ParallelMcts> parallelMcts(m, "ParallelMCTS");
+
+    parallelMcts.def(
+        py::init([](size_t numThreads, uint32_t numSimulations,
+                    uint32_t leavesPerRound, float cPuct, float dirichletAlpha,
+                    float dirichletEpsilon, float virtualLoss, uint64_t seed) {
+            MctsConfig config;
+            config.numSimulations = numSimulations;
+            config.leavesPerRound = leavesPerRound;
+            config.cPuct = cPuct;
+            config.dirichletAlpha = dirichletAlpha;
+            config.dirichletEpsilon = dirichletEpsilon;
+            config.virtualLoss = virtualLoss;
+            return std::make_unique<ParallelMcts>(config, numThreads, seed);
+        }),
+        py::arg("num_threads"), py::arg("num_simulations") = 800,
+        py::arg("leaves_per_round") = 32, py::arg("c_puct") = 1.25f,
+        py::arg("dirichlet_alpha") = 0.3f,
+        py::arg("dirichlet_epsilon") = 0.25f, py::arg("virtual_loss") = 1.0f,
+        py::arg("seed") = 0);
+    parallelMcts.def(
+        "reset",
+        [](ParallelMcts &self, const ChessGameEnv &env) {
+            self.reset(env.getState());
+        },
+        py::arg("env"));
+    parallelMcts.def("reset",
+                     [](ParallelMcts &self) { self.reset(GameState()); });
+    parallelMcts.def("advance", &ParallelMcts::advance, py::arg("action"),
+                     py::call_guard<py::gil_scoped_release>());
+    parallelMcts.def(
+        "search",
+        [](ParallelMcts &self, py::function evaluate) {
+            const MctsEvaluator evaluator = wrapEvaluator(evaluate);
+            withoutGil([&] { self.search(evaluator); });
+        },
+        py::arg("evaluate"), SEARCH_DOC);
+    parallelMcts.def("visit_counts", [](const ParallelMcts &self) {
+        py::array_t<float> counts(ACTION_SPACE_SIZE);
+        self.getVisitCounts(counts.mutable_data());
+        return counts;
+    });
+    parallelMcts.def("root_value", &ParallelMcts::getRootValue);
 }
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+// bump allocator for objects that are all dropped at the same time. the
+// memory of a reset is handed out again, so after the first few searches
+// the arena doesn't allocate at all
+class Arena {
+   public:
+    explicit Arena(size_t blockSize = 1 << 20) : blockSize(blockSize) {}
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    Arena(Arena&&) = default;
+    Arena& operator=(Arena&&) = default;
+
+    // count value initialized objects, they are never destroyed
+    template <typename T>
+    T* allocate(size_t count = 1) {
+        static_assert(std::is_trivially_destructible_v<T>);
+        T* objects =
+            static_cast<T*>(allocateBytes(count * sizeof(T), alignof(T)));
+        for (size_t i = 0; i < count; i++) new (objects + i) T();
+        return objects;
+    }
+
+    // forgets every allocation but keeps the blocks
+    void reset() {
+        currentBlock = 0;
+        offset = 0;
+    }
+
+    size_t getCapacity() const {
+        size_t capacity = 0;
+        for (const Block& block : blocks) capacity += block.size;
+        return capacity;
+    }
+
+   private:
+    struct Block {
+        std::unique_ptr<std::byte[]> data;
+        size_t size;
+    };
+
+    void* allocateBytes(size_t size, size_t alignment) {
+        while (currentBlock < blocks.size()) {
+            const Block& block = blocks[currentBlock];
+            const uintptr_t base =
+                reinterpret_cast<uintptr_t>(block.data.get());
+            const uintptr_t aligned =
+                (base + offset + alignment - 1) & ~(alignment - 1);
+            if (aligned + size <= base + block.size) {
+                offset = aligned + size - base;
+                return reinterpret_cast<void*>(aligned);
+            }
+            currentBlock++;
+            offset = 0;
+        }
+        // larger requests than blockSize get a block of their own
+        const size_t newSize = std::max(blockSize, size + alignment);
+        blocks.push_back(
+            Block{std::unique_ptr<std::byte[]>(new std::byte[newSize]),
+                  newSize});
+        return allocateBytes(size, alignment);
+    }
+
+    std::vector<Block> blocks;
+    size_t blockSize;
+    size_t currentBlock = 0;
+    size_t offset = 0;
+};
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "game_env.hpp"
+#include "game_state_utils.hpp"
+#include "playout.hpp"
+#include "thread_pool.hpp"
+#include "types.hpp"
+
+// N independent games that are stepped and observed together so that a
+// caller can advance every game with a single call. the buffers passed to
+// the observe functions hold the rows of all games back to back. with more
+// than one thread the games are spread over a ThreadPool
+class BatchedChessEnv {
+   public:
+    explicit BatchedChessEnv(size_t numEnvs, size_t numThreads = 1,
+                             bool pinThreads = false)
+        : envs(numEnvs), isLegal(numEnvs) {
+        if (numThreads > 1) {
+            pool = std::make_unique<ThreadPool>(numThreads, pinThreads);
+        }
+    }
+
+    size_t size() const { return envs.size(); }
+
+    ChessGameEnv& operator[](size_t index) { return envs[index]; }
+    const ChessGameEnv& operator[](size_t index) const { return envs[index]; }
+
+    void reset();
+    void reset(size_t index);
+
+    // plays actions[i] in game i
+    void step(const Action* actions);
+
+    // obs[N, OBSERVATION_SPACE_SIZE], mask[N, ACTION_SPACE_SIZE],
+    // rewards[N, 2] as white and black reward and done[N]
+    void observeInto(uint8_t* obs, uint8_t* mask, int32_t* rewards,
+                     uint8_t* done) const;
+    // same with planes[N, NUM_OBSERVATION_PLANES] instead of obs
+    void observePlanesInto(Bitboard* planes, uint8_t* mask, int32_t* rewards,
+                           uint8_t* done) const;
+
+    // the loop of a random self play worker without python in between: it
+    // observes every game, resets the finished ones and plays a uniformly
+    // random legal action in each, numSteps times. returns the number of
+    // games that finished
+    size_t playRandomSteps(uint64_t seed, size_t numSteps);
+
+   private:
+    // calls body(i) for every game, on the pool if there is one
+    template <typename Body>
+    void forEachEnv(Body&& body) const;
+
+    std::vector<ChessGameEnv> envs;
+    // scratch space of step
+    std::vector<uint8_t> isLegal;
+    std::unique_ptr<ThreadPool> pool;
+};
+
+template <typename Body>
+void BatchedChessEnv::forEachEnv(Body&& body) const {
+    if (pool) {
+        pool->parallelFor(envs.size(), body);
+    } else {
+        for (size_t i = 0; i < envs.size(); i++) body(i);
+    }
+}
+
+inline void BatchedChessEnv::reset() {
+    for (ChessGameEnv& env : envs) env = ChessGameEnv();
+}
+
+inline void BatchedChessEnv::reset(size_t index) {
+    if (index >= envs.size()) {
+        throw std::runtime_error("Error: there is no game with index " +
+                                 std::to_string(index) + ".");
+    }
+    envs[index] = ChessGameEnv();
+}
+
+inline void BatchedChessEnv::step(const Action* actions) {
+    // check every action first so that a bad one doesn't leave the batch
+    // half stepped
+    for (size_t i = 0; i < envs.size(); i++) {
+        if (actions[i] >= ACTION_SPACE_SIZE) {
+            throw std::runtime_error("Error: action " +
+                                     std::to_string(actions[i]) +
+                                     " of game " + std::to_string(i) +
+                                     " is out of range.");
+        }
+    }
+    forEachEnv(
+        [&](size_t i) { isLegal[i] = envs[i].isLegalAction(actions[i]); });
+    for (size_t i = 0; i < envs.size(); i++) {
+        if (!isLegal[i]) {
+            throw std::runtime_error("Error: action " +
+                                     std::to_string(actions[i]) +
+                                     " of game " + std::to_string(i) +
+                                     " is not legal.");
+        }
+    }
+    forEachEnv([&](size_t i) { envs[i].step(actions[i]); });
+}
+
+inline void BatchedChessEnv::observeInto(uint8_t* obs, uint8_t* mask,
+                                         int32_t* rewards,
+                                         uint8_t* done) const {
+    forEachEnv([&](size_t i) {
+        const TerminationInfo term =
+            envs[i].observeInto(obs + i * OBSERVATION_SPACE_SIZE,
+                                mask + i * ACTION_SPACE_SIZE);
+        rewards[2 * i] = term.whiteReward;
+        rewards[2 * i + 1] = term.blackReward;
+        done[i] = term.isTerminated;
+    });
+}
+
+inline void BatchedChessEnv::observePlanesInto(Bitboard* planes,
+                                               uint8_t* mask,
+                                               int32_t* rewards,
+                                               uint8_t* done) const {
+    forEachEnv([&](size_t i) {
+        const TerminationInfo term =
+            envs[i].observePlanesInto(planes + i * NUM_OBSERVATION_PLANES,
+                                      mask + i * ACTION_SPACE_SIZE);
+        rewards[2 * i] = term.whiteReward;
+        rewards[2 * i + 1] = term.blackReward;
+        done[i] = term.isTerminated;
+    });
+}
+
+inline size_t BatchedChessEnv::playRandomSteps(uint64_t seed,
+                                               size_t numSteps) {
+    const size_t numEnvs = envs.size();
+    std::vector<uint8_t> obs(numEnvs * OBSERVATION_SPACE_SIZE);
+    std::vector<uint8_t> mask(numEnvs * ACTION_SPACE_SIZE);
+    std::vector<int32_t> rewards(numEnvs * 2);
+    std::vector<uint8_t> done(numEnvs);
+    std::vector<Action> actions(numEnvs);
+    PlayoutRng rng(seed);
+
+    size_t finishedGames = 0;
+    observeInto(obs.data(), mask.data(), rewards.data(), done.data());
+    for (size_t ply = 0; ply < numSteps; ply++) {
+        bool hasReset = false;
+        for (size_t i = 0; i < numEnvs; i++) {
+            if (!done[i]) continue;
+            reset(i);
+            finishedGames++;
+            hasReset = true;
+        }
+        if (hasReset) {
+            observeInto(obs.data(), mask.data(), rewards.data(), done.data());
+        }
+
+        for (size_t i = 0; i < numEnvs; i++) {
+            const uint8_t* row = mask.data() + i * ACTION_SPACE_SIZE;
+            const uint32_t numLegal =
+                ACTION_SPACE_SIZE - std::count(row, row + ACTION_SPACE_SIZE, 0);
+            uint32_t choice = randomIndex(rng, numLegal);
+            for (Action action = 0; action < ACTION_SPACE_SIZE; action++) {
+                if (row[action] && choice-- == 0) {
+                    actions[i] = action;
+                    break;
+                }
+            }
+        }
+        step(actions.data());
+        observeInto(obs.data(), mask.data(), rewards.data(), done.data());
+    }
+    return finishedGames;
+}
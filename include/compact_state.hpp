@@ -0,0 +1,207 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "game_state.hpp"
+#include "game_state_utils.hpp"
+#include "moves.hpp"
+#include "types.hpp"
+
+constexpr uint32_t NO_HISTORY = UINT32_MAX;
+
+// one past position in a HistoryStore, parent is the position before it
+struct HistoryEntry {
+    PastGameState state;
+    uint32_t parent;
+};
+
+// storage of the past positions that many CompactGameStates share. a state
+// only keeps the index of the position it came from, the boards are needed
+// again to fill the history planes of an observation and the keys to find
+// repetitions older than the ring of the state
+class HistoryStore {
+   public:
+    uint32_t push(const PastGameState &state, uint32_t parent) {
+        entries.push_back(HistoryEntry{state, parent});
+        return entries.size() - 1;
+    }
+
+    const HistoryEntry &operator[](uint32_t index) const {
+        return entries[index];
+    }
+
+    uint32_t size() const { return entries.size(); }
+    void clear() { entries.clear(); }
+    // drops the entries pushed after the store had size entries, the states
+    // that point to them can't be used anymore. a self play worker can keep
+    // the size at the start of a game and truncate to it when the game ends
+    void truncate(uint32_t size) {
+        if (size < entries.size()) entries.resize(size);
+    }
+
+   private:
+    std::vector<HistoryEntry> entries;
+};
+
+// a GameState that can be copied with memcpy and fits in four cache lines.
+// it only holds the keys of the last 16 positions since the last
+// irreversible move, the older ones are read from the HistoryStore when the
+// state is unpacked, so repetitions are found as far back as in a GameState
+struct CompactGameState {
+    // a piece is the intersection of a color and a piece type board
+    Bitboard white;
+    Bitboard black;
+    Bitboard pawns;
+    Bitboard knights;
+    Bitboard bishops;
+    Bitboard rooks;
+    Bitboard queens;
+    Bitboard kings;
+
+    uint64_t positionHash;
+    BasicRepetitionHistory<16> positionHashes;
+    // the number of keys in the ring of the full state, more than the ring
+    // above holds if the last irreversible move is more than 16 plies ago
+    uint8_t numRepetitionKeys;
+
+    // entry of the previous position in the HistoryStore
+    uint32_t historyIndex;
+    uint16_t halfMoveClock;
+    uint16_t fullMoveCount;
+    uint8_t statusPattern;
+    // 64 if there is no enpassant square
+    uint8_t enpassantSquare;
+};
+
+static_assert(std::is_trivially_copyable_v<CompactGameState>);
+static_assert(sizeof(CompactGameState) <= 256);
+
+// the keys of the positions since the last irreversible move, the newest
+// ones are in the state and the others in its parent chain in store
+inline void unpackRepetitionKeys(const CompactGameState &compact,
+                                 const HistoryStore &store,
+                                 RepetitionHistory &positionHashes) {
+    if (compact.numRepetitionKeys <= compact.positionHashes.size()) {
+        positionHashes.assign(compact.positionHashes);
+        return;
+    }
+    std::array<uint64_t, RepetitionHistory::capacity> keys;
+    uint32_t historyIndex = compact.historyIndex;
+    for (uint32_t i = 0; i < compact.numRepetitionKeys; i++) {
+        if (historyIndex == NO_HISTORY || historyIndex >= store.size()) {
+            throw std::runtime_error(
+                "Error: the history store is missing positions of the "
+                "state.");
+        }
+        keys[i] = store[historyIndex].state.positionHash;
+        historyIndex = store[historyIndex].parent;
+    }
+    positionHashes.clear();
+    for (uint32_t i = compact.numRepetitionKeys; i > 0; i--) {
+        positionHashes.push(keys[i - 1]);
+    }
+}
+
+// everything but the past boards, they stay empty
+inline GameState unpackGameState(const CompactGameState &compact,
+                                 const HistoryStore &store) {
+    // copying this is cheaper than constructing a state from scratch
+    static const GameState emptyState = GameStateEmpty();
+    GameState state = emptyState;
+    state.w_pawn = compact.white & compact.pawns;
+    state.w_knight = compact.white & compact.knights;
+    state.w_bishop = compact.white & compact.bishops;
+    state.w_rook = compact.white & compact.rooks;
+    state.w_queen = compact.white & compact.queens;
+    state.w_king = compact.white & compact.kings;
+
+    state.b_pawn = compact.black & compact.pawns;
+    state.b_knight = compact.black & compact.knights;
+    state.b_bishop = compact.black & compact.bishops;
+    state.b_rook = compact.black & compact.rooks;
+    state.b_queen = compact.black & compact.queens;
+    state.b_king = compact.black & compact.kings;
+
+    state.status = GameStatus(compact.statusPattern);
+    state.enpassant_board =
+        state.status.enpassant ? 1ull << compact.enpassantSquare : 0ull;
+    state.halfMoveClock = compact.halfMoveClock;
+    state.fullMoveCount = compact.fullMoveCount;
+    state.positionHash = compact.positionHash;
+    unpackRepetitionKeys(compact, store, state.positionHashes);
+    return state;
+}
+
+inline CompactGameState packGameState(const GameState &state,
+                                      uint32_t historyIndex) {
+    CompactGameState compact;
+    compact.white = state.w_pawn | state.w_knight | state.w_bishop |
+                    state.w_rook | state.w_queen | state.w_king;
+    compact.black = state.b_pawn | state.b_knight | state.b_bishop |
+                    state.b_rook | state.b_queen | state.b_king;
+    compact.pawns = state.w_pawn | state.b_pawn;
+    compact.knights = state.w_knight | state.b_knight;
+    compact.bishops = state.w_bishop | state.b_bishop;
+    compact.rooks = state.w_rook | state.b_rook;
+    compact.queens = state.w_queen | state.b_queen;
+    compact.kings = state.w_king | state.b_king;
+
+    compact.positionHash = state.positionHash;
+    compact.positionHashes.assign(state.positionHashes);
+    compact.numRepetitionKeys = state.positionHashes.size();
+    compact.historyIndex = historyIndex;
+    compact.halfMoveClock = state.halfMoveClock;
+    compact.fullMoveCount = state.fullMoveCount;
+    compact.statusPattern = state.status.getStatusPattern();
+    compact.enpassantSquare = SquareOf(state.enpassant_board);
+    return compact;
+}
+
+// the past boards of state are added to store
+inline CompactGameState compressGameState(const GameState &state,
+                                          HistoryStore &store) {
+    uint32_t historyIndex = NO_HISTORY;
+    // positions older than the past boards only need their key
+    for (uint32_t distance = state.positionHashes.size();
+         distance > state.stateHistory.size(); distance--) {
+        PastGameState pastState{};
+        pastState.positionHash = state.positionHashes.get(distance);
+        historyIndex = store.push(pastState, historyIndex);
+    }
+    for (int i = state.stateHistory.size() - 1; i >= 0; i--) {
+        historyIndex = store.push(state.stateHistory[i], historyIndex);
+    }
+    return packGameState(state, historyIndex);
+}
+
+inline GameState expandGameState(const CompactGameState &compact,
+                                 const HistoryStore &store) {
+    GameState state = unpackGameState(compact, store);
+    uint32_t historyIndex = compact.historyIndex;
+    for (PastGameState &pastState : state.stateHistory) {
+        if (historyIndex == NO_HISTORY) break;
+        pastState = store[historyIndex].state;
+        historyIndex = store[historyIndex].parent;
+    }
+    return state;
+}
+
+// same as ChessGameEnv::step, the current board is added to store
+inline void makeMove(CompactGameState &compact, HistoryStore &store,
+                     Action action) {
+    GameState state = unpackGameState(compact, store);
+    const PastGameState pastState(state);
+    const uint32_t historyIndex = store.push(pastState, compact.historyIndex);
+    state.positionHashes.push(pastState.positionHash);
+
+    if (state.status.isWhite)
+        makeMove<true>(state, action);
+    else
+        makeMove<false>(state, action);
+
+    compact = packGameState(state, historyIndex);
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include "game_state.hpp"
+#include "playout.hpp"
+
+// key of everything the observation of state is built from: the position,
+// the 7 past positions, the halfmove clock and the repetition flags. two
+// states with the same key get the same observation, so they can share the
+// output of the network
+inline uint64_t getEvaluationKey(const GameState& state) {
+    uint64_t repetitions =
+        state.positionHashes.count(state.getPositionHash(), 0) > 0;
+    PlayoutRng mix(state.positionHash ^ state.halfMoveClock);
+    uint64_t key = mix();
+    for (uint32_t i = 0; i < state.stateHistory.size(); i++) {
+        const uint64_t posHash = state.stateHistory[i].positionHash;
+        const bool isRep = state.positionHashes.count(posHash, i + 1) > 1;
+        repetitions |= static_cast<uint64_t>(isRep) << (i + 1);
+        // the mixing is done again for every board so the order counts
+        mix.state = key ^ posHash;
+        key = mix();
+    }
+    mix.state = key ^ repetitions;
+    return mix();
+}
+
+// bounded map from evaluation keys to the priors of the legal moves and the
+// value the network returned. it is split into shards with a lock each so
+// that many searches can share one cache, a full shard evicts with the clock
+// algorithm: the hand skips and clears entries that were used since it last
+// passed them
+class EvalCache {
+   public:
+    explicit EvalCache(size_t capacity, size_t shardCount = 64);
+
+    EvalCache(const EvalCache&) = delete;
+    EvalCache& operator=(const EvalCache&) = delete;
+
+    // copies the priors and the value of key, false if key isn't cached
+    bool lookup(uint64_t key, std::vector<float>& priors, float& value);
+    // priors has one entry per legal move, an existing entry is replaced
+    void insert(uint64_t key, const float* priors, size_t numPriors,
+                float value);
+    void clear();
+
+    size_t size() const;
+    size_t getCapacity() const { return numShards * shardCapacity; }
+    uint64_t getHits() const { return hits; }
+    uint64_t getMisses() const { return misses; }
+
+   private:
+    struct Entry {
+        uint64_t key;
+        float value;
+        bool isReferenced;
+        // keeps its memory when the entry is evicted
+        std::vector<float> priors;
+    };
+
+    struct alignas(64) Shard {
+        mutable std::mutex mutex;
+        std::vector<Entry> entries;
+        // key to index in entries
+        std::unordered_map<uint64_t, uint32_t> index;
+        size_t hand = 0;
+    };
+
+    Shard& getShard(uint64_t key) const {
+        // the low bits pick the bucket of the map in the shard
+        return shards[(key >> 32) % numShards];
+    }
+    uint32_t evict(Shard& shard);
+
+    size_t numShards;
+    size_t shardCapacity;
+    std::unique_ptr<Shard[]> shards;
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+};
+
+inline EvalCache::EvalCache(size_t capacity, size_t shardCount)
+    : numShards(std::clamp<size_t>(shardCount, 1,
+                                   std::max<size_t>(capacity, 1))),
+      shardCapacity((capacity + numShards - 1) / numShards),
+      shards(new Shard[numShards]) {
+    if (capacity == 0) {
+        throw std::runtime_error("Error: the cache needs a capacity.");
+    }
+    for (size_t i = 0; i < numShards; i++) {
+        shards[i].entries.reserve(shardCapacity);
+        shards[i].index.reserve(shardCapacity);
+    }
+}
+
+inline bool EvalCache::lookup(uint64_t key, std::vector<float>& priors,
+                              float& value) {
+    Shard& shard = getShard(key);
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        const auto it = shard.index.find(key);
+        if (it != shard.index.end()) {
+            Entry& entry = shard.entries[it->second];
+            entry.isReferenced = true;
+            priors.assign(entry.priors.begin(), entry.priors.end());
+            value = entry.value;
+            hits.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    misses.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+inline void EvalCache::insert(uint64_t key, const float* priors,
+                              size_t numPriors, float value) {
+    Shard& shard = getShard(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    uint32_t slot;
+    const auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+        slot = it->second;
+    } else if (shard.entries.size() < shardCapacity) {
+        slot = shard.entries.size();
+        shard.entries.emplace_back();
+        shard.index.emplace(key, slot);
+    } else {
+        slot = evict(shard);
+        shard.index.emplace(key, slot);
+    }
+    Entry& entry = shard.entries[slot];
+    entry.key = key;
+    entry.value = value;
+    // a new entry has to be used once before the hand passes it to survive
+    entry.isReferenced = false;
+    entry.priors.assign(priors, priors + numPriors);
+}
+
+// frees the first entry that wasn't used since the hand last passed it
+inline uint32_t EvalCache::evict(Shard& shard) {
+    while (true) {
+        Entry& entry = shard.entries[shard.hand];
+        const uint32_t slot = shard.hand;
+        shard.hand = (shard.hand + 1) % shard.entries.size();
+        if (entry.isReferenced) {
+            entry.isReferenced = false;
+            continue;
+        }
+        shard.index.erase(entry.key);
+        return slot;
+    }
+}
+
+inline void EvalCache::clear() {
+    for (size_t i = 0; i < numShards; i++) {
+        std::lock_guard<std::mutex> lock(shards[i].mutex);
+        shards[i].entries.clear();
+        shards[i].index.clear();
+        shards[i].hand = 0;
+    }
+    hits = 0;
+    misses = 0;
+}
+
+inline size_t EvalCache::size() const {
+    size_t entries = 0;
+    for (size_t i = 0; i < numShards; i++) {
+        std::lock_guard<std::mutex> lock(shards[i].mutex);
+        entries += shards[i].entries.size();
+    }
+    return entries;
+}
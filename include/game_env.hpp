@@ -6,6 +6,7 @@
 #include <iostream>
 #include <map>
 #include <string>
+#include <vector>
 
 #include "game_state.hpp"
 #include "game_state_utils.hpp"
@@ -16,17 +17,44 @@ class ChessGameEnv {
    public:
     ChessGameEnv() {}
     ChessGameEnv(const std::string& fen) : state(parseFen(fen)) {}
+    // a copy starts at the position of other but can't pop the moves pushed
+    // on other, copying an env stays as cheap as copying its state
     ChessGameEnv(const ChessGameEnv& other) : state(other.state) {}
+    ChessGameEnv& operator=(const ChessGameEnv& other) {
+        state = other.state;
+        undoStack.clear();
+        return *this;
+    }
+    // a moved env keeps its pushed moves
+    ChessGameEnv(ChessGameEnv&& other) = default;
+    ChessGameEnv& operator=(ChessGameEnv&& other) = default;
 
     Moves getPossibleMoves() const;
+    // true if action is one of the legal moves of the player to move
+    bool isLegalAction(Action action) const;
     void step(const Move move);
+    // same as step but the move can be taken back with pop
+    void push(const Action action);
+    void pop();
     ChessObservation observe();
+    // writes the observation and action mask into obs and mask
+    TerminationInfo observeInto(uint8_t* obs, uint8_t* mask) const;
+    // the observation as NUM_OBSERVATION_PLANES bitboards
+    void observePlanes(Bitboard* planes) const;
+    TerminationInfo observePlanesInto(Bitboard* planes, uint8_t* mask) const;
     void showBoard() const;
 
     GameState getState() const;
 
    private:
+    // what push changed, so that pop can restore it
+    struct EnvUndo {
+        HistoryUndo history;
+        UndoInfo move;
+    };
+
     GameState state;
+    std::vector<EnvUndo> undoStack;
 };
 
 void ChessGameEnv::showBoard() const { printBoard(state, 0ull); }
@@ -34,12 +62,39 @@ void ChessGameEnv::showBoard() const { printBoard(state, 0ull); }
 Moves ChessGameEnv::getPossibleMoves() const {
     return Movegen::getLegalMoves(state);
 }
+bool ChessGameEnv::isLegalAction(Action action) const {
+    MoveList moves;
+    Movegen::getLegalMoves(state, moves);
+    for (const Move move : moves) {
+        const Action legalAction = state.status.isWhite
+                                       ? getMoveIndex<true>(move)
+                                       : getMoveIndex<false>(move);
+        if (legalAction == action) return true;
+    }
+    return false;
+}
 ChessObservation ChessGameEnv::observe() {
     if (state.status.isWhite)
         return observeTemplate<true>(state);
     else
         return observeTemplate<false>(state);
 }
+TerminationInfo ChessGameEnv::observeInto(uint8_t* obs, uint8_t* mask) const {
+    if (state.status.isWhite)
+        return observeIntoTemplate<true>(state, obs, mask);
+    else
+        return observeIntoTemplate<false>(state, obs, mask);
+}
+void ChessGameEnv::observePlanes(Bitboard* planes) const {
+    writeObservationPlanes(state, planes);
+}
+TerminationInfo ChessGameEnv::observePlanesInto(Bitboard* planes,
+                                                uint8_t* mask) const {
+    if (state.status.isWhite)
+        return observePlanesIntoTemplate<true>(state, planes, mask);
+    else
+        return observePlanesIntoTemplate<false>(state, planes, mask);
+}
 void ChessGameEnv::step(Move move) {
     state.addHistory(PastGameState(state));
 
@@ -49,4 +104,30 @@ void ChessGameEnv::step(Move move) {
         makeMove<false>(state, move);
 }
 
+void ChessGameEnv::push(Action action) {
+    EnvUndo undo;
+    undo.history = state.addHistory(PastGameState(state));
+
+    if (state.status.isWhite)
+        undo.move = makeMoveWithUndo<true>(state, action);
+    else
+        undo.move = makeMoveWithUndo<false>(state, action);
+    undoStack.push_back(undo);
+}
+
+void ChessGameEnv::pop() {
+    if (undoStack.empty()) {
+        throw std::runtime_error("Error: there is no pushed move to pop.");
+    }
+    const EnvUndo& undo = undoStack.back();
+
+    // the player that made the move is not the one to move now
+    if (state.status.isWhite)
+        unmakeMove<false>(state, undo.move);
+    else
+        unmakeMove<true>(state, undo.move);
+    state.removeHistory(undo.history);
+    undoStack.pop_back();
+}
+
 GameState ChessGameEnv::getState() const { return state; }
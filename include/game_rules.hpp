@@ -6,14 +6,14 @@
 #include "move_gen.hpp"
 
 template <bool isWhite>
-bool isCheckMate(const GameState& state) {
-    const Bitboard enemySeenSquares = Movegen::getSeenSquares<!isWhite>(state);
+bool isCheckMate(const GameState& state, const Movegen::MoveGenContext& ctx) {
     const Bitboard ownKing = getKing<isWhite>(state);
 
     // king is in check
-    if (enemySeenSquares & ownKing) {
+    if (ctx.enemySeenSquares & ownKing) {
         // there are no legal moves
-        const Moves legalMoves = Movegen::getLegalMoves(state);
+        MoveList legalMoves;
+        Movegen::getLegalMoves(state, ctx, legalMoves);
         if (legalMoves.size() == 0) {
             return true;
         }
@@ -22,34 +22,37 @@ bool isCheckMate(const GameState& state) {
 }
 
 template <bool isWhite>
-bool isStaleMate(const GameState& state) {
-    const Bitboard enemySeenSquares = Movegen::getSeenSquares<!isWhite>(state);
+bool isCheckMate(const GameState& state) {
+    return isCheckMate<isWhite>(state,
+                                Movegen::createMoveGenContext<isWhite>(state));
+}
+
+template <bool isWhite>
+bool isStaleMate(const GameState& state, const Movegen::MoveGenContext& ctx) {
     const Bitboard ownKing = getKing<isWhite>(state);
 
     // king is in check
-    if (enemySeenSquares & ownKing) {
+    if (ctx.enemySeenSquares & ownKing) {
         return false;
     }
 
     // there are no legal moves
-    const Moves legalMoves = Movegen::getLegalMoves(state);
+    MoveList legalMoves;
+    Movegen::getLegalMoves(state, ctx, legalMoves);
     if (legalMoves.size() == 0) {
         return true;
     }
     return false;
 }
 
-bool isDrawBy50Moves(const GameState& state) {
-    if (state.halfMoveClock >= 100) {
-        return true;
-    }
-    return false;
+template <bool isWhite>
+bool isStaleMate(const GameState& state) {
+    return isStaleMate<isWhite>(state,
+                                Movegen::createMoveGenContext<isWhite>(state));
 }
 
-bool occursMoreThan(const std::map<uint64_t, int>& map, uint64_t hash,
-                    int threshold) {
-    auto it = map.find(hash);
-    if (it != map.end() && it->second > threshold) {
+bool isDrawBy50Moves(const GameState& state) {
+    if (state.halfMoveClock >= 100) {
         return true;
     }
     return false;
@@ -58,8 +61,7 @@ bool occursMoreThan(const std::map<uint64_t, int>& map, uint64_t hash,
 template <bool isWhite>
 bool isDrawBy3FoldRepetition(const GameState& state) {
     const uint64_t posHash = state.getPositionHash();
-    // std::cout << state.positionHashes.size() << std::endl;
-    return occursMoreThan(state.positionHashes, posHash, 1);
+    return state.positionHashes.count(posHash, 0) > 1;
 }
 
 uint64_t getSquareColor(Bitboard board) {
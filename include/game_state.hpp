@@ -1,8 +1,9 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
-#include <map>
 #include <string>
+#include <type_traits>
 
 #include "game_status.hpp"
 #include "types.hpp"
@@ -32,6 +33,67 @@ struct PastGameState {
     PastGameState(const GameState &state);
 };
 
+// zobrist keys of the positions since the last irreversible move. in a game
+// that follows the rules halfMoveClock bounds this to 100 plies, if it ever
+// gets longer than N the oldest keys are overwritten
+template <uint32_t N>
+struct BasicRepetitionHistory {
+    static constexpr uint32_t capacity = N;
+
+    std::array<uint64_t, capacity> keys;
+    // the keys since the last irreversible move are [begin, end), clearing
+    // only moves begin so that it can be undone by restoring it
+    uint32_t begin;
+    uint32_t end;
+
+    BasicRepetitionHistory() : keys{}, begin(0), end(0) {}
+
+    // returns the key that was overwritten, pop needs it to undo the push
+    uint64_t push(uint64_t key) {
+        const uint64_t overwritten = keys[end % capacity];
+        keys[end++ % capacity] = key;
+        return overwritten;
+    }
+    void pop(uint64_t overwritten) { keys[--end % capacity] = overwritten; }
+    void clear() { begin = end; }
+    uint32_t size() const { return std::min(end - begin, capacity); }
+
+    // key of the position distance plies ago, distance is in [1, size()]
+    uint64_t get(uint32_t distance) const {
+        return keys[(end - distance) % capacity];
+    }
+
+    // a position can only repeat with the same player to move, so only every
+    // other ply is scanned: the positions pliesAgo plies before the current
+    // one, plus or minus a multiple of two plies
+    int count(uint64_t key, uint32_t pliesAgo) const {
+        int occurrences = 0;
+        for (uint32_t distance = 2 - pliesAgo % 2; distance <= size();
+             distance += 2) {
+            occurrences += get(distance) == key;
+        }
+        return occurrences;
+    }
+
+    // keeps the newest keys if other holds more than N
+    template <uint32_t M>
+    void assign(const BasicRepetitionHistory<M> &other) {
+        clear();
+        for (uint32_t distance = std::min(other.size(), N); distance > 0;
+             distance--) {
+            push(other.get(distance));
+        }
+    }
+};
+
+using RepetitionHistory = BasicRepetitionHistory<128>;
+
+// what addHistory overwrote, removeHistory needs it to undo it
+struct HistoryUndo {
+    PastGameState oldest;
+    uint64_t overwrittenKey;
+};
+
 struct GameState {
     Bitboard w_pawn;
     Bitboard w_rook;
@@ -51,8 +113,12 @@ struct GameState {
     uint32_t halfMoveClock;
     uint32_t fullMoveCount;
 
+    // zobrist key of the position, makeMove keeps it up to date. code that
+    // changes the bitboards directly has to call computePositionHash
+    uint64_t positionHash;
+
     std::array<PastGameState, 7> stateHistory;
-    std::map<uint64_t, int> positionHashes;
+    RepetitionHistory positionHashes;
 
     GameStatus status;
 
@@ -72,6 +138,7 @@ struct GameState {
           enpassant_board(0ull),
           halfMoveClock(0ul),
           fullMoveCount(1ul),
+          positionHash(0ull),
           stateHistory(),
           positionHashes(),
           status() {
@@ -81,13 +148,19 @@ struct GameState {
         status.bKingC = true;
         status.bQueenC = true;
         status.enpassant = false;
+        positionHash = computePositionHash();
     }
 
-    void addHistory(const PastGameState &pastState);
+    HistoryUndo addHistory(const PastGameState &pastState);
+    void removeHistory(const HistoryUndo &undo);
     void setEnpassant(Bitboard enpassantBoard);
     void clearEnpassant();
-    uint64_t getPositionHash() const;
+    uint64_t getPositionHash() const { return positionHash; }
+    uint64_t computePositionHash() const;
 };
 
+// copying a state has to stay a memcpy, it is copied for every env copy
+static_assert(std::is_trivially_copyable_v<GameState>);
+
 GameState GameStateEmpty();
 GameState parseFen(const std::string &fen);
@@ -7,11 +7,13 @@
 #include "lookup.hpp"
 #include "move_gen.hpp"
 #include "observation.hpp"
+#include "zobrist.hpp"
 
 constexpr int OBSERVATION_SPACE_SIZE = 7104;
 constexpr int ACTION_SPACE_SIZE = 4672;
 constexpr int NUM_ACTION_PLANES = 73;
 constexpr int PLANE_SIZE = 64;
+constexpr int NUM_OBSERVATION_PLANES = OBSERVATION_SPACE_SIZE / PLANE_SIZE;
 constexpr int MAX_GAME_LENGTH = 250;  // this means that there is 500 half moves
 
 struct TerminationInfo {
@@ -120,6 +122,8 @@ inline bool isCastle(uint8_t ss, uint8_t ts) {
 template <bool isWhite>
 inline void handleCastling(GameState& state, uint8_t sourceSquare,
                            uint8_t targetSquare) {
+    const uint64_t castlingHash = Zobrist::hashCastlingRights(state);
+
     // handle casteling
     if constexpr (isWhite) {
         // left castle
@@ -145,6 +149,17 @@ inline void handleCastling(GameState& state, uint8_t sourceSquare,
     }
     state.status.removeCastlingRights<isWhite>();
     state.positionHashes.clear();
+
+    // the rook jumps from the corner to the square the king passed
+    const uint64_t rookSource =
+        sourceSquare > targetSquare ? sourceSquare - 4 : sourceSquare + 3;
+    const uint64_t rookTarget = (sourceSquare + targetSquare) / 2;
+    state.positionHash ^= castlingHash ^ Zobrist::hashCastlingRights(state);
+    state.positionHash ^=
+        Zobrist::hashPiece<isWhite>(PieceType::King, sourceSquare) ^
+        Zobrist::hashPiece<isWhite>(PieceType::King, targetSquare) ^
+        Zobrist::hashPiece<isWhite>(PieceType::Rook, rookSource) ^
+        Zobrist::hashPiece<isWhite>(PieceType::Rook, rookTarget);
 }
 
 template <bool isWhite>
@@ -177,18 +192,25 @@ template <bool isWhite>
 inline void moveToTargetPosition(GameState& state, Bitboard& pieceBoard,
                                  Bitboard targetBoard, PieceType promotion,
                                  PieceType type) {
+    const uint64_t targetSquare = SquareOf(targetBoard);
     if (type == PieceType::Pawn && targetBoard & lastRank<isWhite>()) {
         Bitboard& promotionBoard =
             getBitboardFromPieceType<isWhite>(state, promotion);
         promotionBoard |= targetBoard;
+        state.positionHash ^=
+            Zobrist::hashPiece<isWhite>(promotion, targetSquare);
     } else {
         pieceBoard |= targetBoard;
+        state.positionHash ^= Zobrist::hashPiece<isWhite>(type, targetSquare);
     }
 }
 
 template <bool isWhite>
 inline void handleEnpassantCapture(GameState& state, Bitboard targetBoard) {
-    removeEnemyPiece<isWhite>(state, pawnPush1<!isWhite>(targetBoard));
+    const Bitboard capturedBoard = pawnPush1<!isWhite>(targetBoard);
+    removeEnemyPiece<isWhite>(state, capturedBoard);
+    state.positionHash ^=
+        Zobrist::hashPiece<!isWhite>(PieceType::Pawn, SquareOf(capturedBoard));
 }
 
 template <bool isWhite>
@@ -249,6 +271,7 @@ inline void updateGameState(GameState& state, ActionInfo ai) {
     // need to do this to ensure the reset of the enpassant
     const bool isEnpassantPossible = state.status.enpassant;
     const Bitboard enpassantBoard = state.enpassant_board;
+    state.positionHash ^= Zobrist::hashEnpassant<isWhite>(state);
     state.clearEnpassant();
 
     // TODO: make this more readable
@@ -258,10 +281,13 @@ inline void updateGameState(GameState& state, ActionInfo ai) {
         return;
     }
 
+    const uint64_t castlingHash = Zobrist::hashCastlingRights(state);
     updateCastlingRights<isWhite>(state, sourceBoard, targetBoard, type);
+    state.positionHash ^= castlingHash ^ Zobrist::hashCastlingRights(state);
 
     Bitboard& pieceBoard = getBitboardFromSquare<isWhite>(state, sourceBoard);
     pieceBoard &= ~sourceBoard;
+    state.positionHash ^= Zobrist::hashPiece<isWhite>(type, sourceSquare);
 
     // handle move
     moveToTargetPosition<isWhite>(state, pieceBoard, targetBoard, promotion,
@@ -277,8 +303,16 @@ inline void updateGameState(GameState& state, ActionInfo ai) {
     // handle enable enpassant
     if (enablesEnpassant<isWhite>(state, sourceBoard, targetBoard, type)) {
         state.setEnpassant(pawnPush1<isWhite>(sourceBoard));
+        // the enpassant key depends on the player that can take
+        state.positionHash ^= Zobrist::hashEnpassant<!isWhite>(state);
         return;
     }
+
+    const PieceType capturedType = getPieceType<!isWhite>(state, targetSquare);
+    if (capturedType != PieceType::None) {
+        state.positionHash ^=
+            Zobrist::hashPiece<!isWhite>(capturedType, targetSquare);
+    }
     removeEnemyPiece<isWhite>(state, targetBoard);
 }
 
@@ -320,12 +354,97 @@ inline void makeMove(GameState& state, Action action) {
     updateMoveCount<isWhite>(state, isPawnMove, isCapture);
 
     state.status.nextPlayer();
+    state.positionHash ^= Zobrist::hashNextPlayer();
+
+#ifdef CHESS_DEBUG_HASH
+    if (state.positionHash != state.computePositionHash()) {
+        throw std::runtime_error(
+            "Error: the incremental zobrist key doesn't match the board.");
+    }
+#endif
+}
+
+// everything unmakeMove needs to restore the state before a move exactly
+struct UndoInfo {
+    ActionInfo actionInfo;
+    PieceType movedType;
+    PieceType capturedType;
+    GameStatus status;
+    Bitboard enpassantBoard;
+    uint64_t positionHash;
+    uint32_t halfMoveClock;
+    uint32_t repetitionBegin;
+};
+
+template <bool isWhite>
+inline UndoInfo makeMoveWithUndo(GameState& state, Action action) {
+    const ActionInfo ai = parseAction<isWhite>(action);
+    const UndoInfo undo{
+        ai,
+        getPieceType<isWhite>(state, ai.sourceSquare),
+        getPieceType<!isWhite>(state, ai.targetSquare),
+        state.status,
+        state.enpassant_board,
+        state.positionHash,
+        state.halfMoveClock,
+        state.positionHashes.begin,
+    };
+    makeMove<isWhite>(state, action);
+    return undo;
+}
+
+// isWhite is the player that made the move
+template <bool isWhite>
+inline void unmakeMove(GameState& state, const UndoInfo& undo) {
+    const uint64_t sourceSquare = undo.actionInfo.sourceSquare;
+    const uint64_t targetSquare = undo.actionInfo.targetSquare;
+    const Bitboard sourceBoard = 1ull << sourceSquare;
+    const Bitboard targetBoard = 1ull << targetSquare;
+
+    if (undo.movedType == PieceType::King &&
+        isCastle<isWhite>(sourceSquare, targetSquare)) {
+        // see handleCastling
+        const uint64_t rookSource =
+            sourceSquare > targetSquare ? sourceSquare - 4 : sourceSquare + 3;
+        const uint64_t rookTarget = (sourceSquare + targetSquare) / 2;
+        getBitboardFromPieceType<isWhite>(state, PieceType::King) = sourceBoard;
+        Bitboard& rooks =
+            getBitboardFromPieceType<isWhite>(state, PieceType::Rook);
+        rooks &= ~(1ull << rookTarget);
+        rooks |= 1ull << rookSource;
+    } else {
+        // a promoted pawn has to be taken from the board of its new piece
+        const bool isPromotion = undo.movedType == PieceType::Pawn &&
+                                 targetBoard & lastRank<isWhite>();
+        const PieceType placedType =
+            isPromotion ? undo.actionInfo.promotion : undo.movedType;
+        getBitboardFromPieceType<isWhite>(state, placedType) &= ~targetBoard;
+        getBitboardFromPieceType<isWhite>(state, undo.movedType) |=
+            sourceBoard;
+
+        if (undo.capturedType != PieceType::None) {
+            getBitboardFromPieceType<!isWhite>(state, undo.capturedType) |=
+                targetBoard;
+        } else if (undo.movedType == PieceType::Pawn &&
+                   undo.status.enpassant && targetBoard & undo.enpassantBoard) {
+            getBitboardFromPieceType<!isWhite>(state, PieceType::Pawn) |=
+                pawnPush1<!isWhite>(targetBoard);
+        }
+    }
+
+    state.status = undo.status;
+    state.enpassant_board = undo.enpassantBoard;
+    state.positionHash = undo.positionHash;
+    state.halfMoveClock = undo.halfMoveClock;
+    state.positionHashes.begin = undo.repetitionBegin;
+    if constexpr (!isWhite) state.fullMoveCount--;
 }
 
-inline void fillObservationWithBoard(std::vector<bool>& obs,
-                                     const PastGameState& pastState,
-                                     int startOffset, bool isWhite,
-                                     bool is2FoldRep) {
+// the 13 planes of a board, the bit of a square in a plane is set when the
+// square is set in the observation
+inline void fillBoardPlanes(Bitboard* planes,
+                            const PastGameState& pastState, bool isWhite,
+                            bool is2FoldRep) {
     constexpr int pawnOffset = 0;
     constexpr int rookOffset = 1;
     constexpr int knightOffset = 2;
@@ -337,18 +456,7 @@ inline void fillObservationWithBoard(std::vector<bool>& obs,
     constexpr int repetitionOffset = 12;
 
     Bitboard w_pawn = pastState.w_pawn;
-    Bitboard w_rook = pastState.w_pawn;
-    Bitboard w_knight = pastState.w_pawn;
-    Bitboard w_bishop = pastState.w_pawn;
-    Bitboard w_queen = pastState.w_pawn;
-    Bitboard w_king = pastState.w_pawn;
-
     Bitboard b_pawn = pastState.b_pawn;
-    Bitboard b_rook = pastState.b_pawn;
-    Bitboard b_knight = pastState.b_pawn;
-    Bitboard b_bishop = pastState.b_pawn;
-    Bitboard b_queen = pastState.b_pawn;
-    Bitboard b_king = pastState.b_pawn;
 
     Bitboard enpassant = pastState.enpassant_board;
 
@@ -360,113 +468,62 @@ inline void fillObservationWithBoard(std::vector<bool>& obs,
         w_pawn |= enpassant << 40;
     }
 
-    Bitloop(w_pawn) {
-        const uint64_t sourceSquare = SquareOf(w_pawn);
-        obs[startOffset + (whiteOffset + pawnOffset) * PLANE_SIZE +
-            sourceSquare] = true;
-    }
-    Bitloop(w_rook) {
-        const uint64_t sourceSquare = SquareOf(w_rook);
-        obs[startOffset + (whiteOffset + rookOffset) * PLANE_SIZE +
-            sourceSquare] = true;
-    }
-    Bitloop(w_knight) {
-        const uint64_t sourceSquare = SquareOf(w_knight);
-        obs[startOffset + (whiteOffset + knightOffset) * PLANE_SIZE +
-            sourceSquare] = true;
-    }
-    Bitloop(w_bishop) {
-        const uint64_t sourceSquare = SquareOf(w_bishop);
-        obs[startOffset + (whiteOffset + bishopOffset) * PLANE_SIZE +
-            sourceSquare] = true;
-    }
-    Bitloop(w_queen) {
-        const uint64_t sourceSquare = SquareOf(w_queen);
-        obs[startOffset + (whiteOffset + queenOffset) * PLANE_SIZE +
-            sourceSquare] = true;
-    }
-    Bitloop(w_king) {
-        const uint64_t sourceSquare = SquareOf(w_king);
-        obs[startOffset + (whiteOffset + kingOffset) * PLANE_SIZE +
-            sourceSquare] = true;
-    }
+    // every piece plane is filled from the pawns, the observations have
+    // always looked like this and the golden master depends on it
+    planes[whiteOffset + pawnOffset] = w_pawn;
+    planes[whiteOffset + rookOffset] = pastState.w_pawn;
+    planes[whiteOffset + knightOffset] = pastState.w_pawn;
+    planes[whiteOffset + bishopOffset] = pastState.w_pawn;
+    planes[whiteOffset + queenOffset] = pastState.w_pawn;
+    planes[whiteOffset + kingOffset] = pastState.w_pawn;
 
-    Bitloop(b_pawn) {
-        const uint64_t sourceSquare = SquareOf(b_pawn);
-        obs[startOffset + (blackOffset + pawnOffset) * PLANE_SIZE +
-            sourceSquare] = true;
-    }
-    Bitloop(b_rook) {
-        const uint64_t sourceSquare = SquareOf(b_rook);
-        obs[startOffset + (blackOffset + rookOffset) * PLANE_SIZE +
-            sourceSquare] = true;
-    }
-    Bitloop(b_knight) {
-        const uint64_t sourceSquare = SquareOf(b_knight);
-        obs[startOffset + (blackOffset + knightOffset) * PLANE_SIZE +
-            sourceSquare] = true;
-    }
-    Bitloop(b_bishop) {
-        const uint64_t sourceSquare = SquareOf(b_bishop);
-        obs[startOffset + (blackOffset + bishopOffset) * PLANE_SIZE +
-            sourceSquare] = true;
-    }
-    Bitloop(b_queen) {
-        const uint64_t sourceSquare = SquareOf(b_queen);
-        obs[startOffset + (blackOffset + queenOffset) * PLANE_SIZE +
-            sourceSquare] = true;
-    }
-    Bitloop(b_king) {
-        const uint64_t sourceSquare = SquareOf(b_king);
-        obs[startOffset + (blackOffset + kingOffset) * PLANE_SIZE +
-            sourceSquare] = true;
-    }
-    std::fill_n(obs.begin() + startOffset + PLANE_SIZE * repetitionOffset,
-                PLANE_SIZE, is2FoldRep);
-}
+    planes[blackOffset + pawnOffset] = b_pawn;
+    planes[blackOffset + rookOffset] = pastState.b_pawn;
+    planes[blackOffset + knightOffset] = pastState.b_pawn;
+    planes[blackOffset + bishopOffset] = pastState.b_pawn;
+    planes[blackOffset + queenOffset] = pastState.b_pawn;
+    planes[blackOffset + kingOffset] = pastState.b_pawn;
 
-inline void addEdgeFinder(std::vector<bool>& obs, int startOffset) {
-    Bitboard border = RANK_1 | RANK_8 | FILE_A | FILE_H;
-    Bitloop(border) {
-        const uint64_t offset = SquareOf(border);
-        obs[startOffset + offset] = true;
-    }
+    planes[repetitionOffset] = is2FoldRep ? ~0ull : 0ull;
 }
 
-inline std::vector<bool> generateObservation(const GameState& state) {
-    constexpr int sideToMoveOffset = PLANE_SIZE * 4;
-    constexpr int moveClockOffset = PLANE_SIZE * 5;
-    constexpr int edgeFinderOffset = PLANE_SIZE * 6;
-    constexpr int currentBoardOffset = PLANE_SIZE * 7;
-    constexpr int boardSize = PLANE_SIZE * 13;
+// one bitboard per plane of the observation, constant planes are 0 or ~0
+inline void writeObservationPlanes(const GameState& state, Bitboard* planes) {
+    constexpr int sideToMoveOffset = 4;
+    constexpr int moveClockOffset = 5;
+    constexpr int edgeFinderOffset = 6;
+    constexpr int currentBoardOffset = 7;
+    constexpr int boardSize = 13;
     constexpr int numPastBoards = 7;
 
-    std::vector<bool> obs(OBSERVATION_SPACE_SIZE);
+    const auto fullPlane = [](bool value) { return value ? ~0ull : 0ull; };
 
     // castling
-    std::fill_n(obs.begin() + PLANE_SIZE * 0, PLANE_SIZE, state.status.wQueenC);
-    std::fill_n(obs.begin() + PLANE_SIZE * 1, PLANE_SIZE, state.status.wKingC);
-    std::fill_n(obs.begin() + PLANE_SIZE * 2, PLANE_SIZE, state.status.bQueenC);
-    std::fill_n(obs.begin() + PLANE_SIZE * 3, PLANE_SIZE, state.status.wKingC);
+    planes[0] = fullPlane(state.status.wQueenC);
+    planes[1] = fullPlane(state.status.wKingC);
+    planes[2] = fullPlane(state.status.bQueenC);
+    planes[3] = fullPlane(state.status.wKingC);
 
     // side to move
-    std::fill_n(obs.begin() + sideToMoveOffset, PLANE_SIZE,
-                state.status.isWhite);
-
-    // 50 move clock
-    const int moveClockIndex = state.halfMoveClock;
-    obs[moveClockOffset + moveClockIndex] = true;
+    planes[sideToMoveOffset] = fullPlane(state.status.isWhite);
 
     // edge finder
-    addEdgeFinder(obs, edgeFinderOffset);
+    planes[moveClockOffset] = 0ull;
+    planes[edgeFinderOffset] = RANK_1 | RANK_8 | FILE_A | FILE_H;
+
+    // 50 move clock, past 63 it spills into the edge finder plane like the
+    // flat observation always did
+    const int moveClockIndex = state.halfMoveClock;
+    planes[moveClockOffset + moveClockIndex / PLANE_SIZE] |=
+        1ull << (moveClockIndex % PLANE_SIZE);
 
     const PastGameState curState = PastGameState(state);
 
     // check if board existed before
     bool is2FoldRep =
-        occursMoreThan(state.positionHashes, state.getPositionHash(), 0);
-    fillObservationWithBoard(obs, curState, currentBoardOffset,
-                             state.status.isWhite, is2FoldRep);
+        state.positionHashes.count(state.getPositionHash(), 0) > 0;
+    fillBoardPlanes(planes + currentBoardOffset, curState,
+                    state.status.isWhite, is2FoldRep);
 
     // past boards
     for (int i = 0; i < numPastBoards; i++) {
@@ -476,74 +533,116 @@ inline std::vector<bool> generateObservation(const GameState& state) {
         const int startOffset = currentBoardOffset + (boardSize * (i + 1));
 
         const uint64_t posHash = oldState.positionHash;
-        bool isRep = occursMoreThan(state.positionHashes, posHash, 1);
+        // the past board is one of the stored positions itself
+        bool isRep = state.positionHashes.count(posHash, i + 1) > 1;
 
-        fillObservationWithBoard(obs, oldState, startOffset, isWhite, isRep);
+        fillBoardPlanes(planes + startOffset, oldState, isWhite, isRep);
     }
-    return obs;
 }
 
-inline bool isRookMove(uint64_t sourceSquare, uint64_t targetSquare) {
-    const Bitboard attacks = Lookup::perSquareRookAttacks[sourceSquare][0];
-    return attacks & (1ull << targetSquare);
+// obs can be any random access iterator so the planes can be written straight
+// into a caller owned buffer, it has to be zeroed already
+template <typename Obs>
+inline void writeObservation(const GameState& state, Obs obs) {
+    std::array<Bitboard, NUM_OBSERVATION_PLANES> planes;
+    writeObservationPlanes(state, planes.data());
+    for (int plane = 0; plane < NUM_OBSERVATION_PLANES; plane++) {
+        Bitboard squares = planes[plane];
+        Bitloop(squares) { obs[plane * PLANE_SIZE + SquareOf(squares)] = true; }
+    }
+}
+
+inline std::vector<bool> generateObservation(const GameState& state) {
+    std::vector<bool> obs(OBSERVATION_SPACE_SIZE);
+    writeObservation(state, obs.begin());
+    return obs;
 }
 
-inline bool isBishopMove(uint64_t sourceSquare, uint64_t targetSquare) {
-    const Bitboard attacks = Lookup::perSquareBishopAttacks[sourceSquare][0];
-    return attacks & (1ull << targetSquare);
+// the under promotions of a pawn move live in planes 64 to 72 of its source
+// square, three for each direction, promoOffset is 0, 1 or 2 for N, B or R
+template <bool isWhite>
+inline Action getUnderPromotionIndex(Action queenIndex, uint64_t sourceSquare,
+                                     uint64_t targetSquare,
+                                     uint64_t promoOffset) {
+    const int64_t offset = convertToColorSquare<isWhite>(targetSquare) -
+                           convertToColorSquare<isWhite>(sourceSquare);
+    const uint64_t plane = ((offset - 7) * 3) + 64 + promoOffset;
+    return queenIndex - queenIndex % NUM_ACTION_PLANES + plane;
 }
 
 template <bool isWhite>
 inline Action getMoveIndex(Move move) {
-    // TODO: make the bit ops here into a function
-    const uint64_t sourceSquare =
-        convertToColorSquare<isWhite>(move & 0b111111);
-    const uint64_t sourceFile = sourceSquare % 8;
-    const uint64_t sourceRank = sourceSquare / 8;
-
-    const uint64_t targetSquare =
-        convertToColorSquare<isWhite>((move >> 6) & 0b111111);
+    const uint64_t sourceSquare = move & 0b111111;
+    const uint64_t targetSquare = (move >> 6) & 0b111111;
     const uint64_t flags = (move >> 12) & 0b1111;
 
-    const int64_t offset = targetSquare - sourceSquare;
+    const Action action =
+        Lookup::getActionIndex<isWhite>(sourceSquare, targetSquare);
 
     // check for non queen promotion
-    // TODO: turn this into a function
     if (flags >= 0b1000 && ((flags & 0b0011) != 0b0011)) {
-        const uint64_t promoOffset = flags & 0b0011;
-        const uint64_t plane = ((offset - 7) * 3) + 64 + promoOffset;
-        return sourceFile * (NUM_ACTION_PLANES * 8) +
-               sourceRank * NUM_ACTION_PLANES + plane;
+        return getUnderPromotionIndex<isWhite>(action, sourceSquare,
+                                               targetSquare, flags & 0b0011);
     }
+    return action;
+}
 
-    // table lookup what move that is
-    uint64_t plane;
-    if (isRookMove(sourceSquare, targetSquare)) {
-        plane = Lookup::getPlaneRook(offset);
-    } else if (isBishopMove(sourceSquare, targetSquare)) {
-        plane = Lookup::getPlaneBishop(offset);
-    } else {
-        plane = Lookup::getPlaneKnight(offset);
+// sets the actions of the generated moves in mask without creating the moves
+// first, mask can be anything that can be indexed with an action
+template <bool isWhite, typename Mask>
+struct ActionMaskSink {
+    Mask& mask;
+
+    void addTargets(uint64_t sourceSquare, Bitboard targets, Bitboard) {
+        Bitloop(targets) {
+            const uint64_t targetSquare = SquareOf(targets);
+            mask[Lookup::getActionIndex<isWhite>(sourceSquare, targetSquare)] =
+                true;
+        }
     }
 
-    return sourceFile * (NUM_ACTION_PLANES * 8) +
-           sourceRank * NUM_ACTION_PLANES + plane;
-}
+    void addPawnTargets(uint64_t sourceSquare, Bitboard targets, Bitboard,
+                        Bitboard) {
+        addTargets(sourceSquare, targets, 0ull);
+    }
+
+    void addPromotionTargets(uint64_t sourceSquare, Bitboard targets,
+                             Bitboard) {
+        Bitloop(targets) {
+            const uint64_t targetSquare = SquareOf(targets);
+            const Action queenIndex =
+                Lookup::getActionIndex<isWhite>(sourceSquare, targetSquare);
+            mask[queenIndex] = true;
+            for (uint64_t promoOffset = 0; promoOffset < 3; promoOffset++) {
+                mask[getUnderPromotionIndex<isWhite>(
+                    queenIndex, sourceSquare, targetSquare, promoOffset)] =
+                    true;
+            }
+        }
+    }
+
+    void addMove(Move move) { mask[getMoveIndex<isWhite>(move)] = true; }
+};
 
 template <bool isWhite>
-inline std::vector<bool> generateLegalActionMask(const GameState& state) {
-    Moves moves = Movegen::getLegalMoves(state);
+inline std::vector<bool> generateLegalActionMask(
+    const GameState& state, const Movegen::MoveGenContext& ctx) {
     std::vector<bool> legalActionMask(ACTION_SPACE_SIZE);
-    for (const Move& move : moves) {
-        const uint64_t moveIndex = getMoveIndex<isWhite>(move);
-        legalActionMask[moveIndex] = true;
-    }
+    ActionMaskSink<isWhite, std::vector<bool>> sink{legalActionMask};
+    Movegen::generateLegalMoves(state, ctx, sink);
     return legalActionMask;
 }
 
 template <bool isWhite>
-inline TerminationInfo checkForTermination(const GameState& state) {
-    if (isCheckMate<isWhite>(state)) {
+inline std::vector<bool> generateLegalActionMask(const GameState& state) {
+    return generateLegalActionMask<isWhite>(
+        state, Movegen::createMoveGenContext<isWhite>(state));
+}
+
+template <bool isWhite>
+inline TerminationInfo checkForTermination(const GameState& state,
+                                           const Movegen::MoveGenContext& ctx) {
+    if (isCheckMate<isWhite>(state, ctx)) {
         if constexpr (isWhite) {
             return TerminationInfo{-1, 1, true};
         } else {
@@ -551,7 +650,7 @@ inline TerminationInfo checkForTermination(const GameState& state) {
         }
     }
 
-    if (isStaleMate<isWhite>(state) || isDrawBy50Moves(state) ||
+    if (isStaleMate<isWhite>(state, ctx) || isDrawBy50Moves(state) ||
         isDrawBy3FoldRepetition<isWhite>(state) ||
         isInsufficientMaterial(state)) {
         // std::cout << "Draw: " << isStaleMate<isWhite>(state)
@@ -567,10 +666,48 @@ inline TerminationInfo checkForTermination(const GameState& state) {
     return TerminationInfo{0, 0, false};
 }
 
+template <bool isWhite>
+inline TerminationInfo checkForTermination(const GameState& state) {
+    return checkForTermination<isWhite>(
+        state, Movegen::createMoveGenContext<isWhite>(state));
+}
+
+// same as observeTemplate but obs and mask are written in place, they need
+// OBSERVATION_SPACE_SIZE and ACTION_SPACE_SIZE bytes
+template <bool isWhite>
+inline TerminationInfo observeIntoTemplate(const GameState& state,
+                                           uint8_t* obs, uint8_t* mask) {
+    const Movegen::MoveGenContext ctx =
+        Movegen::createMoveGenContext<isWhite>(state);
+    std::fill_n(obs, OBSERVATION_SPACE_SIZE, 0);
+    std::fill_n(mask, ACTION_SPACE_SIZE, 0);
+    writeObservation(state, obs);
+    ActionMaskSink<isWhite, uint8_t*> sink{mask};
+    Movegen::generateLegalMoves(state, ctx, sink);
+    return checkForTermination<isWhite>(state, ctx);
+}
+
+// same as observeIntoTemplate with the observation written as bitboards
+template <bool isWhite>
+inline TerminationInfo observePlanesIntoTemplate(const GameState& state,
+                                                 Bitboard* planes,
+                                                 uint8_t* mask) {
+    const Movegen::MoveGenContext ctx =
+        Movegen::createMoveGenContext<isWhite>(state);
+    std::fill_n(mask, ACTION_SPACE_SIZE, 0);
+    writeObservationPlanes(state, planes);
+    ActionMaskSink<isWhite, uint8_t*> sink{mask};
+    Movegen::generateLegalMoves(state, ctx, sink);
+    return checkForTermination<isWhite>(state, ctx);
+}
+
 template <bool isWhite>
 inline ChessObservation observeTemplate(const GameState& state) {
-    const TerminationInfo term = checkForTermination<isWhite>(state);
-    return ChessObservation{
-        generateObservation(state), generateLegalActionMask<isWhite>(state),
-        term.whiteReward, term.blackReward, term.isTerminated};
+    const Movegen::MoveGenContext ctx =
+        Movegen::createMoveGenContext<isWhite>(state);
+    const TerminationInfo term = checkForTermination<isWhite>(state, ctx);
+    return ChessObservation{generateObservation(state),
+                            generateLegalActionMask<isWhite>(state, ctx),
+                            term.whiteReward, term.blackReward,
+                            term.isTerminated};
 }
@@ -1,14 +1,12 @@
 #pragma once
 #include <array>
+#include <bit>
 #include <immintrin.h>
 #include <iostream>
 
 #include "constants.hpp"
 #include "types.hpp"
 
-constexpr uint64_t rookAttackMaskSize = 4096;
-constexpr uint64_t bishopAttackMaskSize = 512;
-
 namespace Lookup {
 
 constexpr std::array<Bitboard, 64> generateKnightAttacks() {
@@ -69,13 +67,40 @@ constexpr std::array<Bitboard, 64> generateBishopAttacks() {
 
 constexpr std::array<Bitboard, 64> bishopAttacks = generateBishopAttacks();
 
-constexpr std::array<std::array<Bitboard, bishopAttackMaskSize>, 64>
-generatePerSquareBishopAttacks() noexcept {
-    std::array<std::array<Bitboard, bishopAttackMaskSize>, 64> perSquareAttacks;
+// the attack tables are packed, every square only gets as many entries as
+// its relevant mask has blocker combinations (2^popcount(mask)) and the
+// offsets tell where the entries of a square start
+constexpr std::array<uint32_t, 64> generateAttackOffsets(
+    const std::array<Bitboard, 64> &relevantMasks) {
+    std::array<uint32_t, 64> offsets;
+    uint32_t offset = 0;
+    for (int ss = 0; ss < 64; ss++) {
+        offsets[ss] = offset;
+        offset += 1u << std::popcount(relevantMasks[ss]);
+    }
+    return offsets;
+}
+
+constexpr uint64_t getAttackTableSize(
+    const std::array<Bitboard, 64> &relevantMasks) {
+    uint64_t size = 0;
+    for (int ss = 0; ss < 64; ss++) {
+        size += 1ull << std::popcount(relevantMasks[ss]);
+    }
+    return size;
+}
+
+constexpr std::array<uint32_t, 64> bishopAttackOffsets =
+    generateAttackOffsets(bishopAttacks);
+constexpr uint64_t bishopAttackTableSize = getAttackTableSize(bishopAttacks);
+
+inline std::array<Bitboard, bishopAttackTableSize> generateBishopAttackTable() {
+    std::array<Bitboard, bishopAttackTableSize> attackTable;
     const Bitboard border = RANK_1 | RANK_8 | FILE_A | FILE_H;
     for (uint64_t ss = 0; ss < 64; ss++) {
         const Bitboard attackMask = bishopAttacks[ss];
-        for (uint64_t i = 0; i < bishopAttackMaskSize; i++) {
+        const uint64_t numCombinations = 1ull << std::popcount(attackMask);
+        for (uint64_t i = 0; i < numCombinations; i++) {
             const Bitboard blockers = _pdep_u64(i, attackMask);
 
             Bitboard attacks = 0ull;
@@ -107,69 +132,27 @@ generatePerSquareBishopAttacks() noexcept {
                 attacks |= targetBoard;
                 if ((targetBoard & blockers) | (targetBoard & border)) break;
             }
-            perSquareAttacks[ss][i] = attacks;
+            attackTable[bishopAttackOffsets[ss] + i] = attacks;
         }
     }
-    return perSquareAttacks;
+    return attackTable;
 }
 
-std::array<std::array<Bitboard, bishopAttackMaskSize>, 64>
-    perSquareBishopAttacks = generatePerSquareBishopAttacks();
-
-constexpr std::array<std::array<Bitboard, bishopAttackMaskSize>, 64>
-generatePerSquareXrayBishopAttacks() noexcept {
-    std::array<std::array<Bitboard, bishopAttackMaskSize>, 64> perSquareAttacks;
-    const Bitboard border = RANK_1 | RANK_8 | FILE_A | FILE_H;
-    for (uint64_t ss = 0; ss < 64; ss++) {
-        const Bitboard attackMask = bishopAttacks[ss];
-        for (uint64_t i = 0; i < bishopAttackMaskSize; i++) {
-            const Bitboard blockers = _pdep_u64(i, attackMask);
+inline const std::array<Bitboard, bishopAttackTableSize> bishopAttackTable =
+    generateBishopAttackTable();
 
-            Bitboard attacks = 0ull;
-            // north-east
-            int hitCount = 0;
-            for (uint64_t ts = ss + 9; ts < 64; ts += 9) {
-                if (1ull << ss & FILE_H) break;
-                const Bitboard targetBoard = 1ull << ts;
-                attacks |= targetBoard;
-                if (targetBoard & blockers) hitCount++;
-                if (hitCount >= 2 || (targetBoard & border)) break;
-            }
-            // south-east
-            hitCount = 0;
-            for (int64_t ts = ss - 7; ts >= 0 && ts < 64; ts -= 7) {
-                if (1ull << ss & FILE_H) break;
-                const Bitboard targetBoard = 1ull << ts;
-                attacks |= targetBoard;
-                if (targetBoard & blockers) hitCount++;
-                if (hitCount >= 2 || (targetBoard & border)) break;
-            }
-            // south-west
-            hitCount = 0;
-            for (uint64_t ts = ss - 9; ts >= 0 && ts < 64; ts -= 9) {
-                if (1ull << ss & FILE_A) break;
-                const Bitboard targetBoard = 1ull << ts;
-                attacks |= targetBoard;
-                if (targetBoard & blockers) hitCount++;
-                if (hitCount >= 2 || (targetBoard & border)) break;
-            }
-            // north-west
-            hitCount = 0;
-            for (uint64_t ts = ss + 7; ts < 64; ts += 7) {
-                if (1ull << ss & FILE_A) break;
-                const Bitboard targetBoard = 1ull << ts;
-                attacks |= targetBoard;
-                if (targetBoard & blockers) hitCount++;
-                if (hitCount >= 2 || (targetBoard & border)) break;
-            }
-            perSquareAttacks[ss][i] = attacks;
-        }
-    }
-    return perSquareAttacks;
+inline Bitboard getBishopAttacks(uint64_t square, Bitboard occupied) {
+    const uint64_t blockIdx = _pext_u64(occupied, bishopAttacks[square]);
+    return bishopAttackTable[bishopAttackOffsets[square] + blockIdx];
 }
 
-std::array<std::array<Bitboard, bishopAttackMaskSize>, 64>
-    perSquareXrayBishopAttacks = generatePerSquareXrayBishopAttacks();
+// attacks that go through the first blocker of every ray and stop at the
+// second one, removing the first blockers and looking up again gives exactly
+// that so there is no need for a separate x-ray table
+inline Bitboard getXrayBishopAttacks(uint64_t square, Bitboard occupied) {
+    const Bitboard attacks = getBishopAttacks(square, occupied);
+    return getBishopAttacks(square, occupied & ~attacks);
+}
 
 constexpr std::array<Bitboard, 64> generateRookAttacks() {
     std::array<Bitboard, 64> squareAttacks;
@@ -201,14 +184,18 @@ constexpr std::array<Bitboard, 64> generateRookAttacks() {
 
 constexpr std::array<Bitboard, 64> rookAttacks = generateRookAttacks();
 
-constexpr std::array<std::array<Bitboard, rookAttackMaskSize>, 64>
-generatePerSquareRookAttacks() noexcept {
-    std::array<std::array<Bitboard, rookAttackMaskSize>, 64> perSquareAttacks;
+constexpr std::array<uint32_t, 64> rookAttackOffsets =
+    generateAttackOffsets(rookAttacks);
+constexpr uint64_t rookAttackTableSize = getAttackTableSize(rookAttacks);
+
+inline std::array<Bitboard, rookAttackTableSize> generateRookAttackTable() {
+    std::array<Bitboard, rookAttackTableSize> attackTable;
     const Bitboard hBorder = RANK_1 | RANK_8;
     const Bitboard vBorder = FILE_A | FILE_H;
     for (uint64_t ss = 0; ss < 64; ss++) {
         const Bitboard attackMask = rookAttacks[ss];
-        for (uint64_t i = 0; i < rookAttackMaskSize; i++) {
+        const uint64_t numCombinations = 1ull << std::popcount(attackMask);
+        for (uint64_t i = 0; i < numCombinations; i++) {
             const Bitboard blockers = _pdep_u64(i, attackMask);
 
             Bitboard attacks = 0ull;
@@ -236,66 +223,25 @@ generatePerSquareRookAttacks() noexcept {
                 attacks |= targetBoard;
                 if ((targetBoard & blockers) | (targetBoard & vBorder)) break;
             }
-            perSquareAttacks[ss][i] = attacks;
+            attackTable[rookAttackOffsets[ss] + i] = attacks;
         }
     }
-    return perSquareAttacks;
+    return attackTable;
 }
 
-std::array<std::array<Bitboard, rookAttackMaskSize>, 64> perSquareRookAttacks =
-    generatePerSquareRookAttacks();
+inline const std::array<Bitboard, rookAttackTableSize> rookAttackTable =
+    generateRookAttackTable();
 
-std::array<std::array<Bitboard, rookAttackMaskSize>, 64>
-generatePerSquareXrayRookAttacks() noexcept {
-    std::array<std::array<Bitboard, rookAttackMaskSize>, 64> perSquareAttacks;
-    const Bitboard hBorder = RANK_1 | RANK_8;
-    const Bitboard vBorder = FILE_A | FILE_H;
-    for (uint64_t ss = 0; ss < 64; ss++) {
-        const Bitboard attackMask = rookAttacks[ss];
-        for (uint64_t i = 0; i < rookAttackMaskSize; i++) {
-            const Bitboard blockers = _pdep_u64(i, attackMask);
-
-            Bitboard attacks = 0ull;
-            // north
-            int hitCount = 0;
-            for (int ts = ss + 8; ts < 64; ts += 8) {
-                const Bitboard targetBoard = 1ull << ts;
-                attacks |= targetBoard;
-                if (targetBoard & blockers) hitCount++;
-                if (hitCount >= 2 || (targetBoard & hBorder)) break;
-            }
-            // east
-            hitCount = 0;
-            for (int ts = ss + 1; ts < 64 && ts % 8 > 0; ts++) {
-                const Bitboard targetBoard = 1ull << ts;
-                attacks |= targetBoard;
-                if (targetBoard & blockers) hitCount++;
-                if (hitCount >= 2 || (targetBoard & vBorder)) break;
-            }
-            // south
-            hitCount = 0;
-            for (int ts = ss - 8; ts >= 0; ts -= 8) {
-                const Bitboard targetBoard = 1ull << ts;
-                attacks |= targetBoard;
-                if (targetBoard & blockers) hitCount++;
-                if ((hitCount >= 2) || (targetBoard & hBorder)) break;
-            }
-            // west
-            hitCount = 0;
-            for (int ts = ss - 1; ts >= 0 && ts % 8 < 7; ts--) {
-                const Bitboard targetBoard = 1ull << ts;
-                attacks |= targetBoard;
-                if (targetBoard & blockers) hitCount++;
-                if (hitCount >= 2 || (targetBoard & vBorder)) break;
-            }
-            perSquareAttacks[ss][i] = attacks;
-        }
-    }
-    return perSquareAttacks;
+inline Bitboard getRookAttacks(uint64_t square, Bitboard occupied) {
+    const uint64_t blockIdx = _pext_u64(occupied, rookAttacks[square]);
+    return rookAttackTable[rookAttackOffsets[square] + blockIdx];
 }
 
-std::array<std::array<Bitboard, rookAttackMaskSize>, 64>
-    perSquareXrayRookAttacks = generatePerSquareXrayRookAttacks();
+// see getXrayBishopAttacks
+inline Bitboard getXrayRookAttacks(uint64_t square, Bitboard occupied) {
+    const Bitboard attacks = getRookAttacks(square, occupied);
+    return getRookAttacks(square, occupied & ~attacks);
+}
 
 constexpr std::array<int8_t, 73> planeToOffsetWhite = {
     -9,  -1,  7,   -8,  8,   -7,  1,   9,   -18, -2,  14,  -16, 16,  -14, 2,
@@ -387,13 +333,16 @@ constexpr std::array<uint8_t, 36> generateOffsetToPlaneKnight() noexcept {
     return inverted;
 }
 
-std::array<uint8_t, 128> offsetToPlaneRook = generateOffsetToPlaneRook();
-std::array<uint8_t, 128> offsetToPlaneBishop = generateOffsetToPlaneBishop();
-std::array<uint8_t, 36> offsetToPlaneKnight = generateOffsetToPlaneKnight();
+constexpr std::array<uint8_t, 128> offsetToPlaneRook =
+    generateOffsetToPlaneRook();
+constexpr std::array<uint8_t, 128> offsetToPlaneBishop =
+    generateOffsetToPlaneBishop();
+constexpr std::array<uint8_t, 36> offsetToPlaneKnight =
+    generateOffsetToPlaneKnight();
 // for white do -7 to get to [0, 3] and for black +9
 // std::array<uint8_t, 3> offsetToPlanePawn = {7, 8, 9}
 
-PieceType getPromotion(uint8_t plane) {
+inline PieceType getPromotion(uint8_t plane) {
     if (plane < 64) return PieceType::Queen;
     switch ((plane - 64) % 3) {
         case 0:
@@ -408,7 +357,7 @@ PieceType getPromotion(uint8_t plane) {
 }
 
 template <bool isWhite>
-int8_t getOffsetFromPlane(uint8_t plane) {
+inline int8_t getOffsetFromPlane(uint8_t plane) {
     if (isWhite)
         return planeToOffsetWhite[plane];
     else
@@ -416,15 +365,63 @@ int8_t getOffsetFromPlane(uint8_t plane) {
 }
 
 // offset + 64 to make it non negative
-uint8_t getPlaneRook(int8_t offset) { return offsetToPlaneRook[offset + 64]; }
+inline uint8_t getPlaneRook(int8_t offset) {
+    return offsetToPlaneRook[offset + 64];
+}
 
-uint8_t getPlaneBishop(int8_t offset) {
+inline uint8_t getPlaneBishop(int8_t offset) {
     return offsetToPlaneBishop[offset + 64];
 }
 
 // 56 here since the queen moves are the first 56 and after
-uint8_t getPlaneKnight(int8_t offset) {
+inline uint8_t getPlaneKnight(int8_t offset) {
     return 56 + offsetToPlaneKnight[offset + 18];
 }
 
+// action index of the move from source to target for every pair of squares
+// from the perspective of the player to move (the board is mirrored for
+// black). promotions to a queen share the index of the plain pawn move and
+// pairs of squares that no piece can move between are left at 0
+template <bool isWhite>
+std::array<std::array<uint16_t, 64>, 64> generateActionIndices() {
+    std::array<std::array<uint16_t, 64>, 64> indices{};
+    for (uint64_t ss = 0; ss < 64; ss++) {
+        const uint64_t sourceSquare = isWhite ? ss : ss ^ 56;
+        const uint64_t sourceFile = sourceSquare % 8;
+        const uint64_t sourceRank = sourceSquare / 8;
+        for (uint64_t ts = 0; ts < 64; ts++) {
+            const uint64_t targetSquare = isWhite ? ts : ts ^ 56;
+            const Bitboard targetBoard = 1ull << targetSquare;
+            const int8_t offset = targetSquare - sourceSquare;
+            uint64_t plane;
+            if (getRookAttacks(sourceSquare, 0ull) & targetBoard) {
+                plane = getPlaneRook(offset);
+            } else if (getBishopAttacks(sourceSquare, 0ull) & targetBoard) {
+                plane = getPlaneBishop(offset);
+            } else if (knightAttacks[sourceSquare] & targetBoard) {
+                plane = getPlaneKnight(offset);
+            } else {
+                continue;
+            }
+            // 73 planes per square, see planeToOffsetWhite
+            indices[ss][ts] = sourceFile * 73 * 8 + sourceRank * 73 + plane;
+        }
+    }
+    return indices;
+}
+
+inline const std::array<std::array<uint16_t, 64>, 64> actionIndicesWhite =
+    generateActionIndices<true>();
+inline const std::array<std::array<uint16_t, 64>, 64> actionIndicesBlack =
+    generateActionIndices<false>();
+
+template <bool isWhite>
+inline uint16_t getActionIndex(uint64_t sourceSquare, uint64_t targetSquare) {
+    if constexpr (isWhite) {
+        return actionIndicesWhite[sourceSquare][targetSquare];
+    } else {
+        return actionIndicesBlack[sourceSquare][targetSquare];
+    }
+}
+
 }  // namespace Lookup
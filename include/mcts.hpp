@@ -0,0 +1,765 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "arena.hpp"
+#include "eval_cache.hpp"
+#include "game_state.hpp"
+#include "game_state_utils.hpp"
+#include "move_gen.hpp"
+#include "playout.hpp"
+#include "types.hpp"
+
+struct MctsConfig {
+    // new simulations per game and call to search
+    uint32_t numSimulations = 800;
+    // leaves that are collected per game before the evaluator is called
+    uint32_t leavesPerRound = 8;
+    float cPuct = 1.25f;
+    float dirichletAlpha = 0.3f;
+    // share of the noise in the root priors, 0 turns it off
+    float dirichletEpsilon = 0.25f;
+    // value every pending visit counts as, it steers the other leaves of a
+    // round away from the path
+    float virtualLoss = 1.0f;
+    // move orders that reach the same position share one node, only used
+    // by BatchedMcts
+    bool useTranspositions = false;
+};
+
+// called with batchSize observations and masks laid out back to back, it
+// has to write batchSize rows of ACTION_SPACE_SIZE priors and batchSize
+// values. a value is from the view of the player to move in its position
+using MctsEvaluator =
+    std::function<void(size_t batchSize, const uint8_t* observations,
+                       const uint8_t* masks, float* priors, float* values)>;
+
+struct MctsNode;
+
+// one move of a node, the statistics of all moves of a node lie next to each
+// other so selection only touches the edge array
+struct MctsEdge {
+    // null until the move is selected the first time
+    MctsNode* child;
+    float prior;
+    // from the view of the player that plays action
+    float valueSum;
+    uint32_t visitCount;
+    // pending visits of leaves that wait for the evaluator
+    uint16_t virtualLosses;
+    uint16_t action;
+};
+
+static_assert(sizeof(MctsEdge) == 24);
+
+struct MctsNode {
+    MctsEdge* edges;
+    // transposition key, only set if transpositions are used
+    uint64_t key;
+    uint32_t visitCount;
+    uint32_t virtualLosses;
+    // from the view of the player that moved into the node
+    float valueSum;
+    // from the view of the player to move, only set for terminal nodes
+    float terminalValue;
+    uint16_t numEdges;
+    bool isExpanded;
+    // the leaf is in the batch of the current round
+    bool isPending;
+    bool isTerminal;
+};
+
+// the nodes from the root to a leaf and the edges between them
+struct MctsPath {
+    std::vector<MctsNode*> nodes;
+    std::vector<MctsEdge*> edges;
+};
+
+// the search math below is shared by BatchedMcts and ParallelMcts, it is
+// templated on the node and edge type. the counters of a node or an edge are
+// read through loadStats, parallel_mcts.hpp has the overloads that load its
+// atomics
+
+// the counters of a node or an edge read at one point
+struct MctsStats {
+    float valueSum;
+    uint32_t visitCount;
+    uint32_t virtualLosses;
+};
+
+template <typename T>
+inline MctsStats loadStats(const T& stats) {
+    return MctsStats{stats.valueSum, stats.visitCount, stats.virtualLosses};
+}
+
+// mean value where every pending visit counts as a loss of virtualLoss,
+// unvisited moves count as a draw
+inline float getMeanValue(const MctsStats& stats, float virtualLoss) {
+    const uint32_t visits = stats.visitCount + stats.virtualLosses;
+    if (visits == 0) return 0.0f;
+    return (stats.valueSum - virtualLoss * stats.virtualLosses) / visits;
+}
+
+// mean value of a node from the view of the player to move in it, a node
+// stores its value from the view of the player before it
+inline float getNodeValue(const MctsStats& stats) {
+    if (stats.visitCount == 0) return 0.0f;
+    return -stats.valueSum / stats.visitCount;
+}
+
+// the edge with the highest PUCT score, getQ(edge, stats) is the value of
+// an edge from the view of the player to move at the parent
+template <typename Edge, typename GetQ>
+inline Edge* selectPuctEdge(const MctsStats& parent, Edge* edges,
+                            uint16_t numEdges, const MctsConfig& config,
+                            GetQ&& getQ) {
+    const float parentVisits =
+        static_cast<float>(parent.visitCount + parent.virtualLosses);
+    const float exploration = config.cPuct * std::sqrt(parentVisits);
+
+    Edge* best = nullptr;
+    float bestScore = -INFINITY;
+    for (uint16_t i = 0; i < numEdges; i++) {
+        Edge& edge = edges[i];
+        const MctsStats stats = loadStats(edge);
+        const uint32_t visits = stats.visitCount + stats.virtualLosses;
+        const float score =
+            getQ(edge, stats) + exploration * edge.prior / (1 + visits);
+        if (score > bestScore) {
+            bestScore = score;
+            best = &edge;
+        }
+    }
+    return best;
+}
+
+template <typename Edge>
+inline Edge* selectPuctEdge(const MctsStats& parent, Edge* edges,
+                            uint16_t numEdges, const MctsConfig& config) {
+    return selectPuctEdge(
+        parent, edges, numEdges, config,
+        [&](const Edge&, const MctsStats& stats) {
+            return getMeanValue(stats, config.virtualLoss);
+        });
+}
+
+// sets the action of every move on edges and its prior from priors. priors
+// of illegal actions are dropped, a policy that puts nothing on the legal
+// ones gets a uniform prior
+template <typename Edge>
+inline void initEdges(Edge* edges, const MoveList& moves, bool isWhite,
+                      const float* priors) {
+    float priorSum = 0.0f;
+    for (uint32_t i = 0; i < moves.size(); i++) {
+        Edge& edge = edges[i];
+        edge.action = isWhite ? getMoveIndex<true>(moves[i])
+                              : getMoveIndex<false>(moves[i]);
+        edge.prior = std::max(priors[edge.action], 0.0f);
+        priorSum += edge.prior;
+    }
+    for (uint32_t i = 0; i < moves.size(); i++) {
+        edges[i].prior = priorSum > 0.0f ? edges[i].prior / priorSum
+                                         : 1.0f / moves.size();
+    }
+}
+
+// mixes dirichlet noise into the priors of edges, noise is scratch space
+template <typename Edge>
+inline void mixDirichletNoise(Edge* edges, uint16_t numEdges,
+                              const MctsConfig& config, PlayoutRng& rng,
+                              std::vector<float>& noise) {
+    if (config.dirichletEpsilon <= 0.0f || numEdges == 0) return;
+    std::gamma_distribution<float> gamma(config.dirichletAlpha, 1.0f);
+    noise.resize(numEdges);
+    float noiseSum = 0.0f;
+    for (float& n : noise) {
+        n = gamma(rng);
+        noiseSum += n;
+    }
+    if (noiseSum <= 0.0f) return;
+    for (uint16_t i = 0; i < numEdges; i++) {
+        edges[i].prior = (1 - config.dirichletEpsilon) * edges[i].prior +
+                         config.dirichletEpsilon * noise[i] / noiseSum;
+    }
+}
+
+// turns a pending visit of a node or an edge into a visit with value
+template <typename T>
+inline void addVisit(T& stats, float value) {
+    stats.virtualLosses--;
+    stats.visitCount++;
+    stats.valueSum += value;
+}
+
+template <typename T>
+inline void removeVirtualLoss(T& stats) {
+    stats.virtualLosses--;
+}
+
+// value is from the view of the player to move at the leaf, edges[i] leads
+// from nodes[i] to nodes[i + 1]
+template <typename Node, typename Edge>
+inline void backupPath(const std::vector<Node*>& nodes,
+                       const std::vector<Edge*>& edges, float value) {
+    for (size_t i = nodes.size(); i-- > 0;) {
+        // the player that moved into node is the opponent of the one to move
+        value = -value;
+        addVisit(*nodes[i], value);
+        if (i == 0) break;
+        addVisit(*edges[i - 1], value);
+    }
+}
+
+template <typename Node, typename Edge>
+inline void revertPathVirtualLoss(const std::vector<Node*>& nodes,
+                                  const std::vector<Edge*>& edges) {
+    for (Node* node : nodes) removeVirtualLoss(*node);
+    for (Edge* edge : edges) removeVirtualLoss(*edge);
+}
+
+// visit count of every action of edges, the other actions get 0
+template <typename Edge>
+inline void writeVisitCounts(const Edge* edges, uint16_t numEdges,
+                             float* counts) {
+    std::fill_n(counts, ACTION_SPACE_SIZE, 0.0f);
+    for (uint16_t i = 0; i < numEdges; i++) {
+        counts[edges[i].action] =
+            static_cast<float>(loadStats(edges[i]).visitCount);
+    }
+}
+
+// checks whether the game is over at a leaf and if it isn't generates its
+// legal moves, both with the same move generation context
+inline TerminationInfo getLeafMoves(const GameState& state, MoveList& moves) {
+    const bool isWhite = state.status.isWhite;
+    const Movegen::MoveGenContext ctx =
+        isWhite ? Movegen::createMoveGenContext<true>(state)
+                : Movegen::createMoveGenContext<false>(state);
+    const TerminationInfo term = isWhite
+                                     ? checkForTermination<true>(state, ctx)
+                                     : checkForTermination<false>(state, ctx);
+    moves.clear();
+    if (!term.isTerminated) Movegen::getLegalMoves(state, ctx, moves);
+    return term;
+}
+
+// the observation of a leaf for the evaluator, the mask is built from its
+// legal moves instead of generating them again
+inline void writeLeafObservation(const GameState& state, const MoveList& moves,
+                                 uint8_t* obs, uint8_t* mask) {
+    std::fill_n(obs, OBSERVATION_SPACE_SIZE, 0);
+    std::fill_n(mask, ACTION_SPACE_SIZE, 0);
+    writeObservation(state, obs);
+    for (const Move move : moves) {
+        mask[state.status.isWhite ? getMoveIndex<true>(move)
+                                  : getMoveIndex<false>(move)] = 1;
+    }
+}
+
+// key of the node of state in the transposition table. two move orders
+// only share a node if they reach the same position with the same positions
+// since the last irreversible move, so the repetition and 50 move rules
+// agree on both. the past positions are combined independently of their
+// order, every transposition that ends with a capture or a pawn move shares
+// its node
+inline uint64_t getTranspositionKey(const GameState& state) {
+    uint64_t historySum = state.halfMoveClock;
+    for (uint32_t distance = 1; distance <= state.positionHashes.size();
+         distance++) {
+        PlayoutRng mix(state.positionHashes.get(distance));
+        historySum += mix();
+    }
+    PlayoutRng mix(historySum);
+    return state.positionHash ^ mix();
+}
+
+// open addressing map from transposition keys to the nodes of a tree. like
+// the arena it keeps its memory when it is cleared
+class MctsNodeTable {
+   public:
+    MctsNode* find(uint64_t key) const {
+        if (entries.empty()) return nullptr;
+        const size_t mask = entries.size() - 1;
+        for (size_t i = key & mask;; i = (i + 1) & mask) {
+            if (!entries[i].node) return nullptr;
+            if (entries[i].key == key) return entries[i].node;
+        }
+    }
+
+    // key must not be in the table yet
+    void insert(uint64_t key, MctsNode* node) {
+        if (2 * (numEntries + 1) > entries.size()) grow();
+        const size_t mask = entries.size() - 1;
+        size_t i = key & mask;
+        while (entries[i].node) i = (i + 1) & mask;
+        entries[i] = Entry{key, node};
+        numEntries++;
+    }
+
+    void clear() {
+        std::fill(entries.begin(), entries.end(), Entry{0, nullptr});
+        numEntries = 0;
+    }
+
+    size_t size() const { return numEntries; }
+
+   private:
+    struct Entry {
+        uint64_t key;
+        MctsNode* node;
+    };
+
+    void grow() {
+        std::vector<Entry> old(std::max<size_t>(2 * entries.size(), 1024),
+                               Entry{0, nullptr});
+        std::swap(old, entries);
+        numEntries = 0;
+        for (const Entry& entry : old) {
+            if (entry.node) insert(entry.key, entry.node);
+        }
+    }
+
+    std::vector<Entry> entries;
+    size_t numEntries = 0;
+};
+
+// one search tree per game. the trees are searched together so that the
+// leaves of all games end up in one evaluator call. the nodes of a tree live
+// in an arena that is reset with the tree, the subtree kept by advance is
+// copied into a second arena first. with transpositions the tree is a graph
+// and a table finds the node of a position that is already in it
+class BatchedMcts {
+   public:
+    BatchedMcts(size_t numGames, const MctsConfig& config, uint64_t seed);
+
+    size_t size() const { return trees.size(); }
+
+    // drops the tree of game and starts over from state
+    void reset(size_t game, const GameState& state);
+    // plays action in game and keeps the subtree below it
+    void advance(size_t game, Action action);
+
+    // leaves whose observation is in cache aren't passed to the evaluator
+    // and every evaluation is added to it, null turns the cache off. the
+    // cache can be shared with other searches and has to outlive this one
+    void setEvalCache(EvalCache* evalCache) { cache = evalCache; }
+
+    // runs config.numSimulations simulations in every game
+    void search(const MctsEvaluator& evaluate);
+
+    // visit count of every action at the root of game
+    void getVisitCounts(size_t game, float* counts) const;
+    // mean value of the root from the view of the player to move
+    float getRootValue(size_t game) const;
+    // bytes reserved by the arenas of game
+    size_t getArenaCapacity(size_t game) const;
+    // positions in the transposition table of game
+    size_t getTableSize(size_t game) const;
+
+   private:
+    static constexpr size_t arenaBlockSize = 1 << 16;
+
+    struct Tree {
+        GameState rootState;
+        Arena arena{arenaBlockSize};
+        Arena spareArena{arenaBlockSize};
+        MctsNodeTable table;
+        MctsNodeTable spareTable;
+        MctsNode* root = nullptr;
+        bool rootHasNoise = false;
+    };
+
+    // a leaf that waits for the evaluator
+    struct PendingLeaf {
+        size_t game;
+        MctsPath path;
+        MoveList moves;
+        bool isWhite;
+        uint64_t evaluationKey;
+    };
+
+    Tree& getTree(size_t game);
+    const Tree& getTree(size_t game) const;
+
+    MctsNode* createNode(Tree& tree, const GameState& state) const;
+    MctsEdge* selectEdge(MctsNode& node) const;
+    void selectLeaf(Tree& tree, MctsPath& path, GameState& state) const;
+    void expand(Arena& arena, MctsNode& node, const MoveList& moves,
+                bool isWhite, const float* priors);
+    void expandFromCache(Arena& arena, MctsNode& node, const MoveList& moves,
+                         bool isWhite, const std::vector<float>& movePriors);
+    void addDirichletNoise(MctsNode& node);
+    void backup(const MctsPath& path, float value);
+    void revertVirtualLoss(const MctsPath& path);
+
+    MctsConfig config;
+    PlayoutRng rng;
+    std::vector<Tree> trees;
+    EvalCache* cache = nullptr;
+
+    // reused between rounds
+    std::vector<PendingLeaf> pending;
+    std::vector<uint8_t> observations;
+    std::vector<uint8_t> masks;
+    std::vector<float> priors;
+    std::vector<float> values;
+    std::vector<float> noise;
+    std::vector<float> movePriors;
+};
+
+inline BatchedMcts::BatchedMcts(size_t numGames, const MctsConfig& config,
+                                uint64_t seed)
+    : config(config), rng(seed), trees(numGames) {
+    if (config.leavesPerRound == 0) {
+        throw std::runtime_error("Error: leavesPerRound has to be positive.");
+    }
+    for (Tree& tree : trees) tree.root = createNode(tree, tree.rootState);
+}
+
+inline BatchedMcts::Tree& BatchedMcts::getTree(size_t game) {
+    if (game >= trees.size()) {
+        throw std::runtime_error("Error: there is no game with index " +
+                                 std::to_string(game) + ".");
+    }
+    return trees[game];
+}
+
+inline const BatchedMcts::Tree& BatchedMcts::getTree(size_t game) const {
+    return const_cast<BatchedMcts*>(this)->getTree(game);
+}
+
+inline void BatchedMcts::reset(size_t game, const GameState& state) {
+    Tree& tree = getTree(game);
+    tree.rootState = state;
+    tree.arena.reset();
+    tree.table.clear();
+    tree.root = createNode(tree, tree.rootState);
+    tree.rootHasNoise = false;
+}
+
+// plays action in state the same way ChessGameEnv::step does
+inline void applyAction(GameState& state, Action action) {
+    state.addHistory(PastGameState(state));
+    if (state.status.isWhite)
+        makeMove<true>(state, action);
+    else
+        makeMove<false>(state, action);
+}
+
+// the actions of all legal moves in state
+inline std::vector<Action> getLegalActions(const GameState& state) {
+    MoveList moves;
+    Movegen::getLegalMoves(state, moves);
+    std::vector<Action> actions(moves.size());
+    for (uint32_t i = 0; i < moves.size(); i++) {
+        actions[i] = state.status.isWhite ? getMoveIndex<true>(moves[i])
+                                          : getMoveIndex<false>(moves[i]);
+    }
+    return actions;
+}
+
+// copies node and everything below it into arena. with a table the nodes
+// that are reached on several paths are only copied once, the copies are
+// entered into the table
+inline MctsNode* copySubtree(const MctsNode& node, Arena& arena,
+                             MctsNodeTable* table = nullptr) {
+    if (table) {
+        if (MctsNode* copy = table->find(node.key)) return copy;
+    }
+    MctsNode* copy = arena.allocate<MctsNode>();
+    *copy = node;
+    if (table) table->insert(node.key, copy);
+    if (node.numEdges == 0) return copy;
+    copy->edges = arena.allocate<MctsEdge>(node.numEdges);
+    for (uint16_t i = 0; i < node.numEdges; i++) {
+        copy->edges[i] = node.edges[i];
+        if (node.edges[i].child) {
+            copy->edges[i].child =
+                copySubtree(*node.edges[i].child, arena, table);
+        }
+    }
+    return copy;
+}
+
+inline void BatchedMcts::advance(size_t game, Action action) {
+    Tree& tree = getTree(game);
+    const std::vector<Action> legal = getLegalActions(tree.rootState);
+    if (std::find(legal.begin(), legal.end(), action) == legal.end()) {
+        throw std::runtime_error("Error: action " + std::to_string(action) +
+                                 " is not legal.");
+    }
+
+    const MctsNode* next = nullptr;
+    for (uint16_t i = 0; i < tree.root->numEdges; i++) {
+        if (tree.root->edges[i].action == action) {
+            next = tree.root->edges[i].child;
+            break;
+        }
+    }
+    tree.spareArena.reset();
+    tree.spareTable.clear();
+    MctsNode* root =
+        next ? copySubtree(*next, tree.spareArena,
+                           config.useTranspositions ? &tree.spareTable
+                                                    : nullptr)
+             : nullptr;
+    std::swap(tree.arena, tree.spareArena);
+    std::swap(tree.table, tree.spareTable);
+    applyAction(tree.rootState, action);
+    tree.root = root ? root : createNode(tree, tree.rootState);
+    tree.rootHasNoise = false;
+}
+
+// a node for the position state, with transpositions it is the node of the
+// table if the position is already in the tree
+inline MctsNode* BatchedMcts::createNode(Tree& tree,
+                                         const GameState& state) const {
+    if (!config.useTranspositions) return tree.arena.allocate<MctsNode>();
+    const uint64_t key = getTranspositionKey(state);
+    if (MctsNode* node = tree.table.find(key)) return node;
+    MctsNode* node = tree.arena.allocate<MctsNode>();
+    node->key = key;
+    tree.table.insert(key, node);
+    return node;
+}
+
+inline MctsEdge* BatchedMcts::selectEdge(MctsNode& node) const {
+    if (!config.useTranspositions) {
+        return selectPuctEdge(loadStats(node), node.edges, node.numEdges,
+                              config);
+    }
+    return selectPuctEdge(
+        loadStats(node), node.edges, node.numEdges, config,
+        [&](const MctsEdge& edge, const MctsStats& stats) {
+            // a shared child has the values of every path that reaches it
+            if (edge.child) {
+                const MctsStats child = loadStats(*edge.child);
+                if (child.visitCount + child.virtualLosses > 0) {
+                    return getMeanValue(child, config.virtualLoss);
+                }
+            }
+            return getMeanValue(stats, config.virtualLoss);
+        });
+}
+
+// walks down to a leaf, path gets every node and edge from the root to the
+// leaf and state the position of the leaf. everything on the path gets a
+// virtual loss. a move into a position that is already expanded elsewhere in
+// the tree ends the walk as well
+inline void BatchedMcts::selectLeaf(Tree& tree, MctsPath& path,
+                                    GameState& state) const {
+    path.nodes.clear();
+    path.edges.clear();
+    state = tree.rootState;
+    MctsNode* node = tree.root;
+    node->virtualLosses++;
+    path.nodes.push_back(node);
+    while (node->isExpanded && !node->isTerminal) {
+        MctsEdge* edge = selectEdge(*node);
+        applyAction(state, edge->action);
+        const bool isNewEdge = !edge->child;
+        if (isNewEdge) edge->child = createNode(tree, state);
+        node = edge->child;
+        edge->virtualLosses++;
+        node->virtualLosses++;
+        path.edges.push_back(edge);
+        path.nodes.push_back(node);
+        if (isNewEdge && node->isExpanded) break;
+    }
+}
+
+inline void BatchedMcts::expand(Arena& arena, MctsNode& node,
+                                const MoveList& moves, bool isWhite,
+                                const float* priors) {
+    node.edges = arena.allocate<MctsEdge>(moves.size());
+    node.numEdges = moves.size();
+    initEdges(node.edges, moves, isWhite, priors);
+    node.isExpanded = true;
+}
+
+// movePriors are the normalized priors of moves that expand stored in the
+// cache
+inline void BatchedMcts::expandFromCache(Arena& arena, MctsNode& node,
+                                         const MoveList& moves, bool isWhite,
+                                         const std::vector<float>& movePriors) {
+    node.edges = arena.allocate<MctsEdge>(moves.size());
+    node.numEdges = moves.size();
+    for (uint32_t i = 0; i < moves.size(); i++) {
+        MctsEdge& edge = node.edges[i];
+        edge.action = isWhite ? getMoveIndex<true>(moves[i])
+                              : getMoveIndex<false>(moves[i]);
+        edge.prior = movePriors[i];
+    }
+    node.isExpanded = true;
+}
+
+inline void BatchedMcts::addDirichletNoise(MctsNode& node) {
+    mixDirichletNoise(node.edges, node.numEdges, config, rng, noise);
+}
+
+inline void BatchedMcts::backup(const MctsPath& path, float value) {
+    backupPath(path.nodes, path.edges, value);
+}
+
+inline void BatchedMcts::revertVirtualLoss(const MctsPath& path) {
+    revertPathVirtualLoss(path.nodes, path.edges);
+}
+
+inline void BatchedMcts::search(const MctsEvaluator& evaluate) {
+    std::vector<uint32_t> remaining(trees.size(), config.numSimulations);
+    for (Tree& tree : trees) {
+        if (tree.root->isExpanded && !tree.rootHasNoise) {
+            addDirichletNoise(*tree.root);
+            tree.rootHasNoise = true;
+        }
+    }
+
+    const size_t maxBatchSize = trees.size() * config.leavesPerRound;
+    observations.resize(maxBatchSize * OBSERVATION_SPACE_SIZE);
+    masks.resize(maxBatchSize * ACTION_SPACE_SIZE);
+    priors.resize(maxBatchSize * ACTION_SPACE_SIZE);
+    values.resize(maxBatchSize);
+    pending.resize(maxBatchSize);
+
+    MctsPath path;
+    GameState state;
+    bool isDone = false;
+    while (!isDone) {
+        isDone = true;
+        size_t batchSize = 0;
+        for (size_t game = 0; game < trees.size(); game++) {
+            Tree& tree = trees[game];
+            for (uint32_t leaf = 0;
+                 leaf < config.leavesPerRound && remaining[game] > 0;
+                 leaf++) {
+                selectLeaf(tree, path, state);
+                MctsNode* node = path.nodes.back();
+
+                // another leaf of this round took the same path, the rest
+                // of this game waits for the next round
+                if (node->isPending) {
+                    revertVirtualLoss(path);
+                    break;
+                }
+                remaining[game]--;
+
+                if (node->isTerminal) {
+                    backup(path, node->terminalValue);
+                    continue;
+                }
+                // a transposition, its value is used instead of evaluating
+                // the position again
+                if (node->isExpanded) {
+                    backup(path, getNodeValue(loadStats(*node)));
+                    continue;
+                }
+
+                const bool isWhite = state.status.isWhite;
+                PendingLeaf& pendingLeaf = pending[batchSize];
+                const TerminationInfo term =
+                    getLeafMoves(state, pendingLeaf.moves);
+                if (term.isTerminated) {
+                    node->isTerminal = true;
+                    node->terminalValue =
+                        isWhite ? term.whiteReward : term.blackReward;
+                    backup(path, node->terminalValue);
+                    continue;
+                }
+
+                if (cache) {
+                    pendingLeaf.evaluationKey = getEvaluationKey(state);
+                    float value;
+                    // the size only differs if two keys collide
+                    if (cache->lookup(pendingLeaf.evaluationKey, movePriors,
+                                      value) &&
+                        movePriors.size() == pendingLeaf.moves.size()) {
+                        expandFromCache(tree.arena, *node, pendingLeaf.moves,
+                                        isWhite, movePriors);
+                        if (node == tree.root) {
+                            addDirichletNoise(*node);
+                            tree.rootHasNoise = true;
+                        }
+                        backup(path, value);
+                        continue;
+                    }
+                }
+
+                // only a leaf that goes to the network needs its
+                // observation
+                writeLeafObservation(
+                    state, pendingLeaf.moves,
+                    observations.data() + batchSize * OBSERVATION_SPACE_SIZE,
+                    masks.data() + batchSize * ACTION_SPACE_SIZE);
+
+                node->isPending = true;
+                pendingLeaf.game = game;
+                pendingLeaf.path.nodes = path.nodes;
+                pendingLeaf.path.edges = path.edges;
+                pendingLeaf.isWhite = isWhite;
+                batchSize++;
+            }
+            if (remaining[game] > 0) isDone = false;
+        }
+
+        if (batchSize == 0) continue;
+        try {
+            evaluate(batchSize, observations.data(), masks.data(),
+                     priors.data(), values.data());
+        } catch (...) {
+            // leave the trees as they were before the round
+            for (size_t i = 0; i < batchSize; i++) {
+                pending[i].path.nodes.back()->isPending = false;
+                revertVirtualLoss(pending[i].path);
+            }
+            throw;
+        }
+
+        for (size_t i = 0; i < batchSize; i++) {
+            PendingLeaf& pendingLeaf = pending[i];
+            MctsNode* node = pendingLeaf.path.nodes.back();
+            Tree& tree = trees[pendingLeaf.game];
+            expand(tree.arena, *node, pendingLeaf.moves, pendingLeaf.isWhite,
+                   priors.data() + i * ACTION_SPACE_SIZE);
+            // stored before the root gets its noise
+            if (cache) {
+                movePriors.resize(node->numEdges);
+                for (uint16_t j = 0; j < node->numEdges; j++) {
+                    movePriors[j] = node->edges[j].prior;
+                }
+                cache->insert(pendingLeaf.evaluationKey, movePriors.data(),
+                              movePriors.size(), values[i]);
+            }
+            if (node == tree.root) {
+                addDirichletNoise(*node);
+                tree.rootHasNoise = true;
+            }
+            node->isPending = false;
+            backup(pendingLeaf.path, values[i]);
+        }
+    }
+}
+
+inline void BatchedMcts::getVisitCounts(size_t game, float* counts) const {
+    const MctsNode& root = *getTree(game).root;
+    writeVisitCounts(root.edges, root.numEdges, counts);
+}
+
+inline float BatchedMcts::getRootValue(size_t game) const {
+    return getNodeValue(loadStats(*getTree(game).root));
+}
+
+inline size_t BatchedMcts::getTableSize(size_t game) const {
+    return getTree(game).table.size();
+}
+
+inline size_t BatchedMcts::getArenaCapacity(size_t game) const {
+    const Tree& tree = getTree(game);
+    return tree.arena.getCapacity() + tree.spareArena.getCapacity();
+}
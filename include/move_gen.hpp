@@ -1,4 +1,5 @@
 #pragma once
+#include <bit>
 #include <exception>
 #include <vector>
 
@@ -14,8 +15,92 @@ Move create_move(Bitboard from, Bitboard to, uint64_t flags) {
     return (from & 0x3f) | ((to & 0x3f) << 6) | ((flags & 0xf) << 12);
 }
 
+// everything the move generation needs to know about a position from the
+// perspective of the player to move, computed once per position
+struct MoveGenContext {
+    Bitboard enemies;
+    Bitboard friendlies;
+    Bitboard occupied;
+    Bitboard checkMask;
+    Bitboard pinMaskHV;
+    Bitboard pinMaskDG;
+    Bitboard enemySeenSquares;
+};
+
+// the generators below only compute the legal target squares of each piece
+// and hand them to a sink, which decides what to make of them. this one
+// turns them into moves, ActionMaskSink turns them into action indices and
+// MoveCountSink only counts them
+struct MoveListSink {
+    MoveList &moves;
+
+    // non pawn moves, targets that hold an enemy piece are captures
+    void addTargets(uint64_t sourceSquare, Bitboard targets,
+                    Bitboard enemies) {
+        Bitloop(targets) {
+            const uint64_t targetSquare = SquareOf(targets);
+            const Bitboard targetBoard = 1ull << targetSquare;
+            const uint64_t flags = (enemies & targetBoard) >> targetSquare << 2;
+            moves.push_back(create_move(sourceSquare, targetSquare, flags));
+        }
+    }
+
+    // pawn moves that don't promote, attacks are the squares the pawn can
+    // capture on and doublePush is the square of a double push
+    void addPawnTargets(uint64_t sourceSquare, Bitboard targets,
+                        Bitboard attacks, Bitboard doublePush) {
+        Bitloop(targets) {
+            const uint64_t targetSquare = SquareOf(targets);
+            const Bitboard targetBoard = 1ull << targetSquare;
+            uint64_t flags = 0ull;
+            flags |= (targetBoard & attacks) >> targetSquare << 2;
+            flags |= (targetBoard & doublePush) >> targetSquare;
+            moves.push_back(create_move(sourceSquare, targetSquare, flags));
+        }
+    }
+
+    // every target is added once for each promotion piece
+    void addPromotionTargets(uint64_t sourceSquare, Bitboard targets,
+                             Bitboard attacks) {
+        Bitloop(targets) {
+            const uint64_t targetSquare = SquareOf(targets);
+            const Bitboard targetBoard = 1ull << targetSquare;
+            const uint64_t flags = (targetBoard & attacks) >> targetSquare << 2;
+            moves.push_back(
+                create_move(sourceSquare, targetSquare, flags | 0b1000));
+            moves.push_back(
+                create_move(sourceSquare, targetSquare, flags | 0b1001));
+            moves.push_back(
+                create_move(sourceSquare, targetSquare, flags | 0b1010));
+            moves.push_back(
+                create_move(sourceSquare, targetSquare, flags | 0b1011));
+        }
+    }
+
+    // castles and en passant captures
+    void addMove(Move move) { moves.push_back(move); }
+};
+
+// counts the moves by popcounting the targets, a promotion counts once for
+// every piece the pawn can promote to. castles and en passant captures are
+// fully checked before they reach a sink so they are counted exactly
+struct MoveCountSink {
+    uint64_t count = 0;
+
+    void addTargets(uint64_t, Bitboard targets, Bitboard) {
+        count += std::popcount(targets);
+    }
+    void addPawnTargets(uint64_t, Bitboard targets, Bitboard, Bitboard) {
+        count += std::popcount(targets);
+    }
+    void addPromotionTargets(uint64_t, Bitboard targets, Bitboard) {
+        count += 4 * std::popcount(targets);
+    }
+    void addMove(Move) { count++; }
+};
+
 template <bool isWhite>
-Bitboard getCheckMask(GameState state) {
+Bitboard getCheckMask(const GameState &state) {
     const Bitboard enemies = getEnemyPieces<isWhite>(state);
     const Bitboard friendlies = getFriendlyPieces<isWhite>(state);
     const Bitboard king = getKing<isWhite>(state);
@@ -54,22 +139,16 @@ Bitboard getCheckMask(GameState state) {
         const uint64_t sourceSquare = SquareOf(rooks);
         const Bitboard sourceBoard = 1ull << sourceSquare;
 
-        const Bitboard rookRelevantSquares = Lookup::rookAttacks[sourceSquare];
-        const uint64_t rookBlockIdx =
-            _pext_u64(enemies | friendlies, rookRelevantSquares);
         const Bitboard rookAttacks =
-            Lookup::perSquareRookAttacks[sourceSquare][rookBlockIdx];
+            Lookup::getRookAttacks(sourceSquare, enemies | friendlies);
 
         // this is all ones if king is attacked otherwise all zeros
         const Bitboard broadcasted = broadcastSingleToMask(king & rookAttacks);
 
         // this is more complicated
         // 1. remove the attacks that don't point at the king
-        const Bitboard kingRelevantSquares = Lookup::rookAttacks[kingSquare];
-        const uint64_t kingBlockIdx =
-            _pext_u64(enemies | friendlies, kingRelevantSquares);
         const Bitboard kingAttacks =
-            Lookup::perSquareRookAttacks[kingSquare][kingBlockIdx];
+            Lookup::getRookAttacks(kingSquare, enemies | friendlies);
         Bitboard tempCheckMap = rookAttacks & kingAttacks;
         // 2. include the rook source square
         tempCheckMap |= sourceBoard;
@@ -88,12 +167,8 @@ Bitboard getCheckMask(GameState state) {
         const uint64_t sourceSquare = SquareOf(bishops);
         const Bitboard sourceBoard = 1ull << sourceSquare;
 
-        const Bitboard bishopRelevantSquares =
-            Lookup::bishopAttacks[sourceSquare];
-        const uint64_t bishopBlockIdx =
-            _pext_u64(enemies | friendlies, bishopRelevantSquares);
         const Bitboard bishopAttacks =
-            Lookup::perSquareBishopAttacks[sourceSquare][bishopBlockIdx];
+            Lookup::getBishopAttacks(sourceSquare, enemies | friendlies);
 
         // same as for rook
         const Bitboard broadcasted =
@@ -101,11 +176,8 @@ Bitboard getCheckMask(GameState state) {
 
         // this is more complated
         // 1. remove the attacks that don't point at the king
-        const Bitboard kingRelevantSquares = Lookup::bishopAttacks[kingSquare];
-        const uint64_t kingBlockIdx =
-            _pext_u64(enemies | friendlies, kingRelevantSquares);
         const Bitboard kingAttacks =
-            Lookup::perSquareBishopAttacks[kingSquare][kingBlockIdx];
+            Lookup::getBishopAttacks(kingSquare, enemies | friendlies);
         Bitboard tempCheckMap = bishopAttacks & kingAttacks;
         // 2. include the bishop source square
         tempCheckMap |= sourceBoard;
@@ -136,12 +208,11 @@ Bitboard getCheckMask(GameState state) {
 }
 
 template <bool isWhite>
-Bitboard getPinMaskHV(GameState state) {
+Bitboard getPinMaskHV(const GameState &state, Bitboard checkMask) {
     const Bitboard enemies = getEnemyPieces<isWhite>(state);
     const Bitboard friendlies = getFriendlyPieces<isWhite>(state);
     const Bitboard kingBoard = getKing<isWhite>(state);
     const uint64_t kingSquare = SquareOf(kingBoard);
-    const Bitboard checkMask = getCheckMask<isWhite>(state);
 
     Bitboard pinMask = 0ull;
     Bitboard rooks =
@@ -150,19 +221,13 @@ Bitboard getPinMaskHV(GameState state) {
         const uint64_t sourceSquare = SquareOf(rooks);
         const Bitboard sourceBoard = 1ull << sourceSquare;
 
-        const Bitboard rookRelevantIndices = Lookup::rookAttacks[sourceSquare];
-        const uint64_t rookBlockIdx =
-            _pext_u64(enemies | friendlies, rookRelevantIndices);
         const Bitboard rookAttacks =
-            Lookup::perSquareXrayRookAttacks[sourceSquare][rookBlockIdx];
+            Lookup::getXrayRookAttacks(sourceSquare, enemies | friendlies);
 
-        const Bitboard kingRelevantIndices = Lookup::rookAttacks[kingSquare];
-        const uint64_t kingBlockIdx =
-            _pext_u64(enemies | friendlies, kingRelevantIndices);
         // note that here we add the king to it's own attack
         // to includ it in the combined attacks below
         const Bitboard kingAttacks =
-            Lookup::perSquareXrayRookAttacks[kingSquare][kingBlockIdx] |
+            Lookup::getXrayRookAttacks(kingSquare, enemies | friendlies) |
             kingBoard;
         Bitboard tempPinMask = 0ull;
         tempPinMask |= rookAttacks & kingAttacks;
@@ -196,12 +261,11 @@ Bitboard getPinMaskHV(GameState state) {
 }
 
 template <bool isWhite>
-Bitboard getPinMaskDG(GameState state) {
+Bitboard getPinMaskDG(const GameState &state, Bitboard checkMask) {
     const Bitboard enemies = getEnemyPieces<isWhite>(state);
     const Bitboard friendlies = getFriendlyPieces<isWhite>(state);
     const Bitboard kingBoard = getKing<isWhite>(state);
     const uint64_t kingSquare = SquareOf(kingBoard);
-    const Bitboard checkMask = getCheckMask<isWhite>(state);
 
     Bitboard pinMask = 0ull;
     Bitboard bishops =
@@ -210,20 +274,13 @@ Bitboard getPinMaskDG(GameState state) {
         const uint64_t sourceSquare = SquareOf(bishops);
         const Bitboard sourceBoard = 1ull << sourceSquare;
 
-        const Bitboard bishopRelevantIndices =
-            Lookup::bishopAttacks[sourceSquare];
-        const uint64_t bishopBlockIdx =
-            _pext_u64(enemies | friendlies, bishopRelevantIndices);
         const Bitboard bishopAttacks =
-            Lookup::perSquareXrayBishopAttacks[sourceSquare][bishopBlockIdx];
+            Lookup::getXrayBishopAttacks(sourceSquare, enemies | friendlies);
 
-        const Bitboard kingRelevantIndices = Lookup::bishopAttacks[kingSquare];
-        const uint64_t kingBlockIdx =
-            _pext_u64(enemies | friendlies, kingRelevantIndices);
         // note that here we add the king to it's own attack
         // to includ it in the combined attacks below
         const Bitboard kingAttacks =
-            Lookup::perSquareXrayBishopAttacks[kingSquare][kingBlockIdx] |
+            Lookup::getXrayBishopAttacks(kingSquare, enemies | friendlies) |
             kingBoard;
         Bitboard tempPinMask = 0ull;
         tempPinMask |= bishopAttacks & kingAttacks;
@@ -258,12 +315,21 @@ Bitboard getPinMaskDG(GameState state) {
 }
 
 template <bool isWhite>
-void getLegalPawnMoves(const GameState &state, Bitboard checkMask,
-                       Bitboard pinMaskHV, Bitboard pinMaskDG, Moves &moves) {
-    const Bitboard enemies = getEnemyPieces<isWhite>(state);
-    const Bitboard friendlies = getFriendlyPieces<isWhite>(state);
+Bitboard getPinMaskHV(const GameState &state) {
+    return getPinMaskHV<isWhite>(state, getCheckMask<isWhite>(state));
+}
+
+template <bool isWhite>
+Bitboard getPinMaskDG(const GameState &state) {
+    return getPinMaskDG<isWhite>(state, getCheckMask<isWhite>(state));
+}
+
+template <bool isWhite, typename Sink>
+void getLegalPawnMoves(const GameState &state, const MoveGenContext &ctx,
+                       Sink &sink) {
+    const Bitboard enemies = ctx.enemies;
     const Bitboard pawns = getPawns<isWhite>(state);
-    const Bitboard enemyOrFriendly = enemies | friendlies;
+    const Bitboard enemyOrFriendly = ctx.occupied;
 
     Bitboard pawnsNoPromo = pawns & ~secondLastRank<isWhite>();
     Bitloop(pawnsNoPromo) {
@@ -284,8 +350,8 @@ void getLegalPawnMoves(const GameState &state, Bitboard checkMask,
 
         // this handles DG pinns
         const Bitboard isPinnedDG =
-            broadcastSingleToMask(sourceBoard & pinMaskDG);
-        const Bitboard onPinDGMask = ~isPinnedDG | pinMaskDG;
+            broadcastSingleToMask(sourceBoard & ctx.pinMaskDG);
+        const Bitboard onPinDGMask = ~isPinnedDG | ctx.pinMaskDG;
         targetSquares &= onPinDGMask;
 
         // this removes single and double push moves if we are DG pinned
@@ -294,27 +360,18 @@ void getLegalPawnMoves(const GameState &state, Bitboard checkMask,
 
         // this handles HV pinns
         const Bitboard isPinnedHV =
-            broadcastSingleToMask(sourceBoard & pinMaskHV);
-        const Bitboard onPinHVMask = ~isPinnedHV | pinMaskHV;
+            broadcastSingleToMask(sourceBoard & ctx.pinMaskHV);
+        const Bitboard onPinHVMask = ~isPinnedHV | ctx.pinMaskHV;
         targetSquares &= onPinHVMask;
 
         // this handles checks
-        targetSquares &= checkMask;
+        targetSquares &= ctx.checkMask;
 
-        Bitloop(targetSquares) {
-            const uint64_t targetSquare = SquareOf(targetSquares);
-            const Bitboard targetBoard = 1ull << targetSquare;
-            uint64_t flags = 0ull;
-            flags |= (targetBoard &
-                      pawnAttackLeft<isWhite>(sourceBoard & ~FILE_A)) >>
-                     targetSquare << 2;
-            flags |= (targetBoard &
-                      pawnAttackRight<isWhite>(sourceBoard & ~FILE_H)) >>
-                     targetSquare << 2;
-            flags |=
-                (targetBoard & pawnPush2<isWhite>(sourceBoard)) >> targetSquare;
-            moves.push_back(create_move(sourceSquare, targetSquare, flags));
-        }
+        const Bitboard attacks =
+            pawnAttackLeft<isWhite>(sourceBoard & ~FILE_A) |
+            pawnAttackRight<isWhite>(sourceBoard & ~FILE_H);
+        sink.addPawnTargets(sourceSquare, targetSquares, attacks,
+                            pawnPush2<isWhite>(sourceBoard));
     }
     Bitboard pawnsPromo = pawns & secondLastRank<isWhite>();
     Bitloop(pawnsPromo) {
@@ -329,194 +386,141 @@ void getLegalPawnMoves(const GameState &state, Bitboard checkMask,
 
         // this handles HV pinns
         const Bitboard isPinnedHV =
-            broadcastSingleToMask(sourceBoard & pinMaskHV);
-        const Bitboard onPinHVMask = ~isPinnedHV | pinMaskHV;
+            broadcastSingleToMask(sourceBoard & ctx.pinMaskHV);
+        const Bitboard onPinHVMask = ~isPinnedHV | ctx.pinMaskHV;
         targetSquares &= onPinHVMask;
 
         // this handles DG pinns
         const Bitboard isPinnedDG =
-            broadcastSingleToMask(sourceBoard & pinMaskDG);
-        const Bitboard onPinDGMask = ~isPinnedDG | pinMaskDG;
+            broadcastSingleToMask(sourceBoard & ctx.pinMaskDG);
+        const Bitboard onPinDGMask = ~isPinnedDG | ctx.pinMaskDG;
         targetSquares &= onPinDGMask;
 
         // this handles checks
-        targetSquares &= checkMask;
+        targetSquares &= ctx.checkMask;
 
-        Bitloop(targetSquares) {
-            const uint64_t targetSquare = SquareOf(targetSquares);
-            const Bitboard targetBoard = 1ull << targetSquare;
-            uint64_t flags = 0ull;
-            flags |= (targetBoard &
-                      pawnAttackLeft<isWhite>(sourceBoard & ~FILE_A)) >>
-                     targetSquare << 2;
-            flags |= (targetBoard &
-                      pawnAttackRight<isWhite>(sourceBoard & ~FILE_H)) >>
-                     targetSquare << 2;
-            moves.push_back(
-                create_move(sourceSquare, targetSquare, flags | 0b1000));
-            moves.push_back(
-                create_move(sourceSquare, targetSquare, flags | 0b1001));
-            moves.push_back(
-                create_move(sourceSquare, targetSquare, flags | 0b1010));
-            moves.push_back(
-                create_move(sourceSquare, targetSquare, flags | 0b1011));
-        }
+        const Bitboard attacks =
+            pawnAttackLeft<isWhite>(sourceBoard & ~FILE_A) |
+            pawnAttackRight<isWhite>(sourceBoard & ~FILE_H);
+        sink.addPromotionTargets(sourceSquare, targetSquares, attacks);
     }
 }
 
-template <bool isWhite>
-void getLegalKnightMoves(const GameState &state, Bitboard checkMask,
-                         Bitboard pinMaskHV, Bitboard pinMaskDG, Moves &moves) {
-    const Bitboard friendlies = getFriendlyPieces<isWhite>(state);
-    const Bitboard enemies = getEnemyPieces<isWhite>(state);
+template <bool isWhite, typename Sink>
+void getLegalKnightMoves(const GameState &state, const MoveGenContext &ctx,
+                         Sink &sink) {
+    const Bitboard friendlies = ctx.friendlies;
+    const Bitboard enemies = ctx.enemies;
 
     // search for knights on the board
-    Bitboard knights = getKnights<isWhite>(state) & ~(pinMaskHV | pinMaskDG);
+    Bitboard knights =
+        getKnights<isWhite>(state) & ~(ctx.pinMaskHV | ctx.pinMaskDG);
     Bitloop(knights) {
         const uint64_t sourceSquare = SquareOf(knights);
         Bitboard attackedSquares =
             Lookup::knightAttacks[sourceSquare] & ~friendlies;
         // for each attacked square (as) of the found knight
-        attackedSquares &= checkMask;
-        Bitloop(attackedSquares) {
-            const uint64_t targetSquare = SquareOf(attackedSquares);
-            const Bitboard targetBoard = 1ull << targetSquare;
-            // this should should check if we are capturing an
-            // enemy piece (enemy_pieces & (1ull << as)) and then
-            // shift the bit that is either 1 or 0 to the 3rd least
-            // significant possition which is the capture flag
-            const uint64_t flags = (enemies & targetBoard) >> targetSquare << 2;
-            moves.push_back(create_move(sourceSquare, targetSquare, flags));
-        }
+        attackedSquares &= ctx.checkMask;
+        sink.addTargets(sourceSquare, attackedSquares, enemies);
     }
 }
 
-template <bool isWhite>
-void getLegalBishopMoves(const GameState &state, Bitboard checkMask,
-                         Bitboard pinMaskHV, Bitboard pinMaskDG, Moves &moves) {
-    const Bitboard enemies = getEnemyPieces<isWhite>(state);
-    const Bitboard friendlies = getFriendlyPieces<isWhite>(state);
+template <bool isWhite, typename Sink>
+void getLegalBishopMoves(const GameState &state, const MoveGenContext &ctx,
+                         Sink &sink) {
+    const Bitboard enemies = ctx.enemies;
+    const Bitboard friendlies = ctx.friendlies;
 
     // hv bishops can not move
-    Bitboard bishops = getBishops<isWhite>(state) & ~pinMaskHV;
+    Bitboard bishops = getBishops<isWhite>(state) & ~ctx.pinMaskHV;
     Bitloop(bishops) {
         const uint64_t sourceSquare = SquareOf(bishops);
         const Bitboard sourceBoard = 1ull << sourceSquare;
-        const Bitboard attackMask = Lookup::bishopAttacks[sourceSquare];
-        const uint64_t blockIdx = _pext_u64(enemies | friendlies, attackMask);
         Bitboard targetsBoard =
-            Lookup::perSquareBishopAttacks[sourceSquare][blockIdx];
+            Lookup::getBishopAttacks(sourceSquare, ctx.occupied);
         targetsBoard &= ~friendlies;
 
         // this handles diagonal pins
         const Bitboard isPinnedDG =
-            broadcastSingleToMask(sourceBoard & pinMaskDG);
-        const Bitboard onPinDGMask = ~isPinnedDG | pinMaskDG;
+            broadcastSingleToMask(sourceBoard & ctx.pinMaskDG);
+        const Bitboard onPinDGMask = ~isPinnedDG | ctx.pinMaskDG;
         targetsBoard &= onPinDGMask;
 
         // this handles checks
-        targetsBoard &= checkMask;
-        Bitloop(targetsBoard) {
-            const uint64_t targetSquare = SquareOf(targetsBoard);
-            const Bitboard targetBoard = 1ull << targetSquare;
-            const uint64_t flags = (enemies & targetBoard) >> targetSquare << 2;
-            moves.push_back(create_move(sourceSquare, targetSquare, flags));
-        }
+        targetsBoard &= ctx.checkMask;
+        sink.addTargets(sourceSquare, targetsBoard, enemies);
     }
 }
 
-template <bool isWhite>
-void getLegalRookMoves(const GameState &state, Bitboard checkMask,
-                       Bitboard pinMaskHV, Bitboard pinMaskDG, Moves &moves) {
-    const Bitboard enemies = getEnemyPieces<isWhite>(state);
-    const Bitboard friendlies = getFriendlyPieces<isWhite>(state);
+template <bool isWhite, typename Sink>
+void getLegalRookMoves(const GameState &state, const MoveGenContext &ctx,
+                       Sink &sink) {
+    const Bitboard enemies = ctx.enemies;
+    const Bitboard friendlies = ctx.friendlies;
 
     // a diagonally pinned rook can never move
-    Bitboard rooks = getRooks<isWhite>(state) & ~pinMaskDG;
+    Bitboard rooks = getRooks<isWhite>(state) & ~ctx.pinMaskDG;
     Bitloop(rooks) {
         const uint64_t sourceSquare = SquareOf(rooks);
         const Bitboard sourceBoard = 1ull << sourceSquare;
-        Bitboard attackMask = Lookup::rookAttacks[sourceSquare];
-        uint64_t blockIdx = _pext_u64(enemies | friendlies, attackMask);
         Bitboard targetsBoard =
-            Lookup::perSquareRookAttacks[sourceSquare][blockIdx];
+            Lookup::getRookAttacks(sourceSquare, ctx.occupied);
         targetsBoard &= ~friendlies;
 
         // this handles diagonal pins
         const Bitboard isPinnedHV =
-            broadcastSingleToMask(sourceBoard & pinMaskHV);
-        const Bitboard onPinHVMask = ~isPinnedHV | pinMaskHV;
+            broadcastSingleToMask(sourceBoard & ctx.pinMaskHV);
+        const Bitboard onPinHVMask = ~isPinnedHV | ctx.pinMaskHV;
         targetsBoard &= onPinHVMask;
 
         // this handles checks
-        targetsBoard &= checkMask;
-        Bitloop(targetsBoard) {
-            const uint64_t targetSquare = SquareOf(targetsBoard);
-            const Bitboard targetBoard = 1ull << targetSquare;
-            const uint64_t flags = (enemies & targetBoard) >> targetSquare << 2;
-            moves.push_back(create_move(sourceSquare, targetSquare, flags));
-        }
+        targetsBoard &= ctx.checkMask;
+        sink.addTargets(sourceSquare, targetsBoard, enemies);
     }
 }
 
-template <bool isWhite>
-void getLegalQueenMoves(const GameState &state, Bitboard checkMask,
-                        Bitboard pinMaskHV, Bitboard pinMaskDG, Moves &moves) {
-    const Bitboard enemies = getEnemyPieces<isWhite>(state);
-    const Bitboard friendlies = getFriendlyPieces<isWhite>(state);
+template <bool isWhite, typename Sink>
+void getLegalQueenMoves(const GameState &state, const MoveGenContext &ctx,
+                        Sink &sink) {
+    const Bitboard enemies = ctx.enemies;
+    const Bitboard friendlies = ctx.friendlies;
 
     // rook attacks
-    Bitboard queens = getQueens<isWhite>(state) & ~pinMaskDG;
+    Bitboard queens = getQueens<isWhite>(state) & ~ctx.pinMaskDG;
     Bitloop(queens) {
         const uint64_t sourceSquare = SquareOf(queens);
         const Bitboard sourceBoard = 1ull << sourceSquare;
-        const Bitboard attackMaskRook = Lookup::rookAttacks[sourceSquare];
-        const uint64_t blockIdxRook =
-            _pext_u64(enemies | friendlies, attackMaskRook);
         Bitboard targetsBoard =
-            Lookup::perSquareRookAttacks[sourceSquare][blockIdxRook];
+            Lookup::getRookAttacks(sourceSquare, ctx.occupied);
         targetsBoard &= ~friendlies;
 
         const Bitboard isPinnedHV =
-            broadcastSingleToMask(sourceBoard & pinMaskHV);
-        const Bitboard onPinHVMask = ~isPinnedHV | pinMaskHV;
+            broadcastSingleToMask(sourceBoard & ctx.pinMaskHV);
+        const Bitboard onPinHVMask = ~isPinnedHV | ctx.pinMaskHV;
         targetsBoard &= onPinHVMask;
 
         // this handles checks
-        targetsBoard &= checkMask;
-        Bitloop(targetsBoard) {
-            const uint64_t targetSquare = SquareOf(targetsBoard);
-            const Bitboard targetBoard = 1ull << targetSquare;
-            const uint64_t flags = (enemies & targetBoard) >> targetSquare << 2;
-            moves.push_back(create_move(sourceSquare, targetSquare, flags));
-        }
+        targetsBoard &= ctx.checkMask;
+        sink.addTargets(sourceSquare, targetsBoard, enemies);
     }
     // bishop attacks
-    queens = getQueens<isWhite>(state) & ~pinMaskHV;
+    queens = getQueens<isWhite>(state) & ~ctx.pinMaskHV;
     Bitloop(queens) {
         const uint64_t sourceSquare = SquareOf(queens);
         const Bitboard sourceBoard = 1ull << sourceSquare;
-        const Bitboard attackMaskBishop = Lookup::bishopAttacks[sourceSquare];
-        const uint64_t blockIdxBishop =
-            _pext_u64(enemies | friendlies, attackMaskBishop);
         Bitboard targetsBoard =
-            Lookup::perSquareBishopAttacks[sourceSquare][blockIdxBishop];
+            Lookup::getBishopAttacks(sourceSquare, ctx.occupied);
 
         targetsBoard &= ~friendlies;
 
         const Bitboard isPinnedDG =
-            broadcastSingleToMask(sourceBoard & pinMaskDG);
-        const Bitboard onPinDGMask = ~isPinnedDG | pinMaskDG;
+            broadcastSingleToMask(sourceBoard & ctx.pinMaskDG);
+        const Bitboard onPinDGMask = ~isPinnedDG | ctx.pinMaskDG;
         targetsBoard &= onPinDGMask;
 
         // this handles checks
-        targetsBoard &= checkMask;
-        Bitloop(targetsBoard) {
-            const uint64_t targetSquare = SquareOf(targetsBoard);
-            const Bitboard targetBoard = 1ull << targetSquare;
-            const uint64_t flags = (enemies & targetBoard) >> targetSquare << 2;
-            moves.push_back(create_move(sourceSquare, targetSquare, flags));
-        }
+        targetsBoard &= ctx.checkMask;
+        sink.addTargets(sourceSquare, targetsBoard, enemies);
     }
 }
 
@@ -563,20 +567,16 @@ Bitboard getSeenSquares(const GameState &state) {
     // rooks (+ queen)
     Bitloop(rooks) {
         const uint64_t sourceSquare = SquareOf(rooks);
-        const Bitboard relevantMask = Lookup::rookAttacks[sourceSquare];
-        const uint64_t blockIdx = _pext_u64(blockingPieces, relevantMask);
         const Bitboard targetsBoard =
-            Lookup::perSquareRookAttacks[sourceSquare][blockIdx];
+            Lookup::getRookAttacks(sourceSquare, blockingPieces);
         seenSquares |= targetsBoard;
     }
 
     // bishops (+ queen)
     Bitloop(bishops) {
         const uint64_t sourceSquare = SquareOf(bishops);
-        const Bitboard relevantMask = Lookup::bishopAttacks[sourceSquare];
-        const uint64_t blockIdx = _pext_u64(blockingPieces, relevantMask);
         const Bitboard targetsBoard =
-            Lookup::perSquareBishopAttacks[sourceSquare][blockIdx];
+            Lookup::getBishopAttacks(sourceSquare, blockingPieces);
         seenSquares |= targetsBoard;
     }
 
@@ -586,27 +586,35 @@ Bitboard getSeenSquares(const GameState &state) {
 }
 
 template <bool isWhite>
-void getLegalKingMoves(const GameState &state, Bitboard enemySeenSquares,
-                       Moves &moves) {
+MoveGenContext createMoveGenContext(const GameState &state) {
+    MoveGenContext ctx;
+    ctx.enemies = getEnemyPieces<isWhite>(state);
+    ctx.friendlies = getFriendlyPieces<isWhite>(state);
+    ctx.occupied = ctx.enemies | ctx.friendlies;
+    ctx.checkMask = getCheckMask<isWhite>(state);
+    ctx.pinMaskHV = getPinMaskHV<isWhite>(state, ctx.checkMask);
+    ctx.pinMaskDG = getPinMaskDG<isWhite>(state, ctx.checkMask);
+    ctx.enemySeenSquares = getSeenSquares<!isWhite>(state);
+    return ctx;
+}
+
+template <bool isWhite, typename Sink>
+void getLegalKingMoves(const GameState &state, const MoveGenContext &ctx,
+                       Sink &sink) {
     const uint64_t kingSquare = SquareOf(getKing<isWhite>(state));
-    const Bitboard enemies = getEnemyPieces<isWhite>(state);
-    const Bitboard friendlies = getFriendlyPieces<isWhite>(state);
+    const Bitboard enemies = ctx.enemies;
     const Bitboard attackedSquares = getKingAttacks<isWhite>(state);
 
-    Bitboard validTargets = attackedSquares & ~enemySeenSquares & ~friendlies;
-    Bitloop(validTargets) {
-        const uint64_t targetSquare = SquareOf(validTargets);
-        const Bitboard targetBoard = 1ull << targetSquare;
-        const uint64_t flags = (enemies & targetBoard) >> targetSquare << 2;
-        moves.push_back(create_move(kingSquare, targetSquare, flags));
-    }
+    Bitboard validTargets =
+        attackedSquares & ~ctx.enemySeenSquares & ~ctx.friendlies;
+    sink.addTargets(kingSquare, validTargets, enemies);
 }
-template <GameStatus status>
-void getLegalCastleMoves(const GameState &state, Bitboard seenSquares,
-                         Bitboard checkMask, Moves &moves) {
-    const Bitboard enemies = getEnemyPieces<status.isWhite>(state);
-    const Bitboard friendlies = getFriendlyPieces<status.isWhite>(state);
-    if (SquareOf(~checkMask) < 64) {
+template <GameStatus status, typename Sink>
+void getLegalCastleMoves(const MoveGenContext &ctx, Sink &sink) {
+    const Bitboard enemies = ctx.enemies;
+    const Bitboard friendlies = ctx.friendlies;
+    const Bitboard seenSquares = ctx.enemySeenSquares;
+    if (SquareOf(~ctx.checkMask) < 64) {
         return;
     }
     if constexpr (status.isWhite && status.wQueenC) {
@@ -615,7 +623,7 @@ void getLegalCastleMoves(const GameState &state, Bitboard seenSquares,
         if (!((relevantSeenSquares & seenSquares) |
               (relevantPieceSquares & friendlies) |
               (relevantPieceSquares & enemies))) {
-            moves.push_back(create_move(4ull, 2ull, 0b0011));
+            sink.addMove(create_move(4ull, 2ull, 0b0011));
         }
     }
     if constexpr (status.isWhite && status.wKingC) {
@@ -624,7 +632,7 @@ void getLegalCastleMoves(const GameState &state, Bitboard seenSquares,
         if (!((relevantSeenSquares & seenSquares) |
               (relevantPieceSquares & friendlies) |
               (relevantPieceSquares & enemies))) {
-            moves.push_back(create_move(4ull, 6ull, 0b0010));
+            sink.addMove(create_move(4ull, 6ull, 0b0010));
         }
     }
     if constexpr (!status.isWhite && status.bQueenC) {
@@ -633,7 +641,7 @@ void getLegalCastleMoves(const GameState &state, Bitboard seenSquares,
         if (!((relevantSeenSquares & seenSquares) |
               (relevantPieceSquares & friendlies) |
               (relevantPieceSquares & enemies))) {
-            moves.push_back(create_move(60ull, 58ull, 0b0011));
+            sink.addMove(create_move(60ull, 58ull, 0b0011));
         }
     }
     if constexpr (!status.isWhite && status.bKingC) {
@@ -642,7 +650,7 @@ void getLegalCastleMoves(const GameState &state, Bitboard seenSquares,
         if (!((relevantSeenSquares & seenSquares) |
               (relevantPieceSquares & friendlies) |
               (relevantPieceSquares & enemies))) {
-            moves.push_back(create_move(60ull, 62ull, 0b0010));
+            sink.addMove(create_move(60ull, 62ull, 0b0010));
         }
     }
 }
@@ -663,10 +671,8 @@ Bitboard getEnemyBishopSeenSquaresAfterEnpassant(const GameState &state,
     Bitboard seenSquares = 0ull;
     Bitloop(bishops) {
         const uint64_t sourceSquare = SquareOf(bishops);
-        const Bitboard relevantMask = Lookup::bishopAttacks[sourceSquare];
-        const uint64_t blockIdx = _pext_u64(blockingPieces, relevantMask);
         const Bitboard targetsBoard =
-            Lookup::perSquareBishopAttacks[sourceSquare][blockIdx];
+            Lookup::getBishopAttacks(sourceSquare, blockingPieces);
         seenSquares |= targetsBoard;
     }
     return seenSquares;
@@ -688,17 +694,15 @@ Bitboard getEnemyRookSeenSquaresAfterEnpassant(const GameState &state,
     Bitboard seenSquares = 0ull;
     Bitloop(rooks) {
         const uint64_t sourceSquare = SquareOf(rooks);
-        const Bitboard relevantMask = Lookup::rookAttacks[sourceSquare];
-        const uint64_t blockIdx = _pext_u64(blockingPieces, relevantMask);
         const Bitboard targetsBoard =
-            Lookup::perSquareRookAttacks[sourceSquare][blockIdx];
+            Lookup::getRookAttacks(sourceSquare, blockingPieces);
         seenSquares |= targetsBoard;
     }
     return seenSquares;
 }
 
-template <bool isWhite>
-void getLegalEnpassantCaptures(const GameState &state, Moves &moves) {
+template <bool isWhite, typename Sink>
+void getLegalEnpassantCaptures(const GameState &state, Sink &sink) {
     const Bitboard king = getKing<isWhite>(state);
     const Bitboard enemyEnpassant = state.enpassant_board;
     const Bitboard pawns = getPawns<isWhite>(state);
@@ -717,175 +721,267 @@ void getLegalEnpassantCaptures(const GameState &state, Moves &moves) {
             getEnemyRookSeenSquaresAfterEnpassant<isWhite>(state, sourceSquare);
         const Bitboard seenSquares = bishopSeenSquares | rookSeenSquares;
         if (!(seenSquares & king)) {
-            moves.push_back(
+            sink.addMove(
                 create_move(sourceSquare, SquareOf(enemyEnpassant), 0b0101));
         }
     }
 }
 
-template <GameStatus status>
-Moves getLegalMovesTemplate(const GameState &state) {
-    const Bitboard checkMask = getCheckMask<status.isWhite>(state);
-    const Bitboard pinMaskHV = getPinMaskHV<status.isWhite>(state);
-    const Bitboard pinMaskDG = getPinMaskDG<status.isWhite>(state);
-    const Bitboard enemySeenSquares = getSeenSquares<!status.isWhite>(state);
-
-    Moves moves;
-    getLegalPawnMoves<status.isWhite>(state, checkMask, pinMaskHV, pinMaskDG,
-                                      moves);
-    getLegalKnightMoves<status.isWhite>(state, checkMask, pinMaskHV, pinMaskDG,
-                                        moves);
-    getLegalRookMoves<status.isWhite>(state, checkMask, pinMaskHV, pinMaskDG,
-                                      moves);
-    getLegalBishopMoves<status.isWhite>(state, checkMask, pinMaskHV, pinMaskDG,
-                                        moves);
-    getLegalQueenMoves<status.isWhite>(state, checkMask, pinMaskHV, pinMaskDG,
-                                       moves);
-    getLegalKingMoves<status.isWhite>(state, enemySeenSquares, moves);
+template <GameStatus status, typename Sink>
+void getLegalMovesTemplate(const GameState &state, const MoveGenContext &ctx,
+                           Sink &sink) {
+    getLegalPawnMoves<status.isWhite>(state, ctx, sink);
+    getLegalKnightMoves<status.isWhite>(state, ctx, sink);
+    getLegalRookMoves<status.isWhite>(state, ctx, sink);
+    getLegalBishopMoves<status.isWhite>(state, ctx, sink);
+    getLegalQueenMoves<status.isWhite>(state, ctx, sink);
+    getLegalKingMoves<status.isWhite>(state, ctx, sink);
     if constexpr (status.wKingC || status.wQueenC || status.bKingC ||
                   status.bQueenC) {
-        getLegalCastleMoves<status>(state, enemySeenSquares, checkMask, moves);
+        getLegalCastleMoves<status>(ctx, sink);
     }
     if constexpr (status.enpassant) {
-        getLegalEnpassantCaptures<status.isWhite>(state, moves);
+        getLegalEnpassantCaptures<status.isWhite>(state, sink);
     }
-    return moves;
 }
 
-Moves getLegalMoves(const GameState &state) {
+// ctx has to be created for the player that is to move in state
+template <typename Sink>
+void generateLegalMoves(const GameState &state, const MoveGenContext &ctx,
+                        Sink &sink) {
     switch (state.status.getStatusPattern()) {
         case 0b000000:
-            return getLegalMovesTemplate<GameStatus(0b000000ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b000000ull)>(
+                state, ctx, sink);
         case 0b000001:
-            return getLegalMovesTemplate<GameStatus(0b000001ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b000001ull)>(
+                state, ctx, sink);
         case 0b000010:
-            return getLegalMovesTemplate<GameStatus(0b000010ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b000010ull)>(
+                state, ctx, sink);
         case 0b000011:
-            return getLegalMovesTemplate<GameStatus(0b000011ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b000011ull)>(
+                state, ctx, sink);
         case 0b000100:
-            return getLegalMovesTemplate<GameStatus(0b000100ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b000100ull)>(
+                state, ctx, sink);
         case 0b000101:
-            return getLegalMovesTemplate<GameStatus(0b000101ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b000101ull)>(
+                state, ctx, sink);
         case 0b000110:
-            return getLegalMovesTemplate<GameStatus(0b000110ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b000110ull)>(
+                state, ctx, sink);
         case 0b000111:
-            return getLegalMovesTemplate<GameStatus(0b000111ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b000111ull)>(
+                state, ctx, sink);
         case 0b001000:
-            return getLegalMovesTemplate<GameStatus(0b001000ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b001000ull)>(
+                state, ctx, sink);
         case 0b001001:
-            return getLegalMovesTemplate<GameStatus(0b001001ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b001001ull)>(
+                state, ctx, sink);
         case 0b001010:
-            return getLegalMovesTemplate<GameStatus(0b001010ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b001010ull)>(
+                state, ctx, sink);
         case 0b001011:
-            return getLegalMovesTemplate<GameStatus(0b001011ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b001011ull)>(
+                state, ctx, sink);
         case 0b001100:
-            return getLegalMovesTemplate<GameStatus(0b001100ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b001100ull)>(
+                state, ctx, sink);
         case 0b001101:
-            return getLegalMovesTemplate<GameStatus(0b001101ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b001101ull)>(
+                state, ctx, sink);
         case 0b001110:
-            return getLegalMovesTemplate<GameStatus(0b001110ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b001110ull)>(
+                state, ctx, sink);
         case 0b001111:
-            return getLegalMovesTemplate<GameStatus(0b001111ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b001111ull)>(
+                state, ctx, sink);
         case 0b010000:
-            return getLegalMovesTemplate<GameStatus(0b010000ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b010000ull)>(
+                state, ctx, sink);
         case 0b010001:
-            return getLegalMovesTemplate<GameStatus(0b010001ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b010001ull)>(
+                state, ctx, sink);
         case 0b010010:
-            return getLegalMovesTemplate<GameStatus(0b010010ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b010010ull)>(
+                state, ctx, sink);
         case 0b010011:
-            return getLegalMovesTemplate<GameStatus(0b010011ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b010011ull)>(
+                state, ctx, sink);
         case 0b010100:
-            return getLegalMovesTemplate<GameStatus(0b010100ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b010100ull)>(
+                state, ctx, sink);
         case 0b010101:
-            return getLegalMovesTemplate<GameStatus(0b010101ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b010101ull)>(
+                state, ctx, sink);
         case 0b010110:
-            return getLegalMovesTemplate<GameStatus(0b010110ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b010110ull)>(
+                state, ctx, sink);
         case 0b010111:
-            return getLegalMovesTemplate<GameStatus(0b010111ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b010111ull)>(
+                state, ctx, sink);
         case 0b011000:
-            return getLegalMovesTemplate<GameStatus(0b011000ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b011000ull)>(
+                state, ctx, sink);
         case 0b011001:
-            return getLegalMovesTemplate<GameStatus(0b011001ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b011001ull)>(
+                state, ctx, sink);
         case 0b011010:
-            return getLegalMovesTemplate<GameStatus(0b011010ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b011010ull)>(
+                state, ctx, sink);
         case 0b011011:
-            return getLegalMovesTemplate<GameStatus(0b011011ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b011011ull)>(
+                state, ctx, sink);
         case 0b011100:
-            return getLegalMovesTemplate<GameStatus(0b011100ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b011100ull)>(
+                state, ctx, sink);
         case 0b011101:
-            return getLegalMovesTemplate<GameStatus(0b011101ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b011101ull)>(
+                state, ctx, sink);
         case 0b011110:
-            return getLegalMovesTemplate<GameStatus(0b011110ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b011110ull)>(
+                state, ctx, sink);
         case 0b011111:
-            return getLegalMovesTemplate<GameStatus(0b011111ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b011111ull)>(
+                state, ctx, sink);
         case 0b100000:
-            return getLegalMovesTemplate<GameStatus(0b100000ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b100000ull)>(
+                state, ctx, sink);
         case 0b100001:
-            return getLegalMovesTemplate<GameStatus(0b100001ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b100001ull)>(
+                state, ctx, sink);
         case 0b100010:
-            return getLegalMovesTemplate<GameStatus(0b100010ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b100010ull)>(
+                state, ctx, sink);
         case 0b100011:
-            return getLegalMovesTemplate<GameStatus(0b100011ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b100011ull)>(
+                state, ctx, sink);
         case 0b100100:
-            return getLegalMovesTemplate<GameStatus(0b100100ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b100100ull)>(
+                state, ctx, sink);
         case 0b100101:
-            return getLegalMovesTemplate<GameStatus(0b100101ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b100101ull)>(
+                state, ctx, sink);
         case 0b100110:
-            return getLegalMovesTemplate<GameStatus(0b100110ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b100110ull)>(
+                state, ctx, sink);
         case 0b100111:
-            return getLegalMovesTemplate<GameStatus(0b100111ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b100111ull)>(
+                state, ctx, sink);
         case 0b101000:
-            return getLegalMovesTemplate<GameStatus(0b101000ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b101000ull)>(
+                state, ctx, sink);
         case 0b101001:
-            return getLegalMovesTemplate<GameStatus(0b101001ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b101001ull)>(
+                state, ctx, sink);
         case 0b101010:
-            return getLegalMovesTemplate<GameStatus(0b101010ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b101010ull)>(
+                state, ctx, sink);
         case 0b101011:
-            return getLegalMovesTemplate<GameStatus(0b101011ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b101011ull)>(
+                state, ctx, sink);
         case 0b101100:
-            return getLegalMovesTemplate<GameStatus(0b101100ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b101100ull)>(
+                state, ctx, sink);
         case 0b101101:
-            return getLegalMovesTemplate<GameStatus(0b101101ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b101101ull)>(
+                state, ctx, sink);
         case 0b101110:
-            return getLegalMovesTemplate<GameStatus(0b101110ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b101110ull)>(
+                state, ctx, sink);
         case 0b101111:
-            return getLegalMovesTemplate<GameStatus(0b101111ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b101111ull)>(
+                state, ctx, sink);
         case 0b110000:
-            return getLegalMovesTemplate<GameStatus(0b110000ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b110000ull)>(
+                state, ctx, sink);
         case 0b110001:
-            return getLegalMovesTemplate<GameStatus(0b110001ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b110001ull)>(
+                state, ctx, sink);
         case 0b110010:
-            return getLegalMovesTemplate<GameStatus(0b110010ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b110010ull)>(
+                state, ctx, sink);
         case 0b110011:
-            return getLegalMovesTemplate<GameStatus(0b110011ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b110011ull)>(
+                state, ctx, sink);
         case 0b110100:
-            return getLegalMovesTemplate<GameStatus(0b110100ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b110100ull)>(
+                state, ctx, sink);
         case 0b110101:
-            return getLegalMovesTemplate<GameStatus(0b110101ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b110101ull)>(
+                state, ctx, sink);
         case 0b110110:
-            return getLegalMovesTemplate<GameStatus(0b110110ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b110110ull)>(
+                state, ctx, sink);
         case 0b110111:
-            return getLegalMovesTemplate<GameStatus(0b110111ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b110111ull)>(
+                state, ctx, sink);
         case 0b111000:
-            return getLegalMovesTemplate<GameStatus(0b111000ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b111000ull)>(
+                state, ctx, sink);
         case 0b111001:
-            return getLegalMovesTemplate<GameStatus(0b111001ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b111001ull)>(
+                state, ctx, sink);
         case 0b111010:
-            return getLegalMovesTemplate<GameStatus(0b111010ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b111010ull)>(
+                state, ctx, sink);
         case 0b111011:
-            return getLegalMovesTemplate<GameStatus(0b111011ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b111011ull)>(
+                state, ctx, sink);
         case 0b111100:
-            return getLegalMovesTemplate<GameStatus(0b111100ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b111100ull)>(
+                state, ctx, sink);
         case 0b111101:
-            return getLegalMovesTemplate<GameStatus(0b111101ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b111101ull)>(
+                state, ctx, sink);
         case 0b111110:
-            return getLegalMovesTemplate<GameStatus(0b111110ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b111110ull)>(
+                state, ctx, sink);
         case 0b111111:
-            return getLegalMovesTemplate<GameStatus(0b111111ull)>(state);
+            return getLegalMovesTemplate<GameStatus(0b111111ull)>(
+                state, ctx, sink);
         default:
             throw std::runtime_error(
                 "Error: the pattern should be exaustive but failed");
     }
 }
 
+// ctx has to be created for the player that is to move in state
+inline void getLegalMoves(const GameState &state, const MoveGenContext &ctx,
+                          MoveList &moves) {
+    MoveListSink sink{moves};
+    generateLegalMoves(state, ctx, sink);
+}
+
+inline void getLegalMoves(const GameState &state, MoveList &moves) {
+    if (state.status.isWhite)
+        getLegalMoves(state, createMoveGenContext<true>(state), moves);
+    else
+        getLegalMoves(state, createMoveGenContext<false>(state), moves);
+}
+
+// ctx has to be created for the player that is to move in state
+inline uint64_t countLegalMoves(const GameState &state,
+                                const MoveGenContext &ctx) {
+    MoveCountSink sink;
+    generateLegalMoves(state, ctx, sink);
+    return sink.count;
+}
+
+inline uint64_t countLegalMoves(const GameState &state) {
+    if (state.status.isWhite)
+        return countLegalMoves(state, createMoveGenContext<true>(state));
+    else
+        return countLegalMoves(state, createMoveGenContext<false>(state));
+}
+
+// compatibility wrapper for callers that want to own the moves
+inline Moves getLegalMoves(const GameState &state) {
+    MoveList moves;
+    getLegalMoves(state, moves);
+    return Moves(moves.begin(), moves.end());
+}
+
 }  // namespace Movegen
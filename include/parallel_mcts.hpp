@@ -0,0 +1,399 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "arena.hpp"
+#include "game_state.hpp"
+#include "game_state_utils.hpp"
+#include "mcts.hpp"
+#include "move_gen.hpp"
+#include "thread_pool.hpp"
+#include "types.hpp"
+
+struct ParallelMctsNode;
+
+// same layout as MctsEdge with counters that several threads may update
+struct ParallelMctsEdge {
+    // published with a compare exchange by the first thread that selects it
+    std::atomic<ParallelMctsNode*> child;
+    float prior;
+    std::atomic<float> valueSum;
+    std::atomic<uint32_t> visitCount;
+    std::atomic<uint16_t> virtualLosses;
+    uint16_t action;
+};
+
+static_assert(sizeof(ParallelMctsEdge) == 24);
+
+enum class NodeState : uint8_t { New, Pending, Expanded, Terminal };
+
+struct ParallelMctsNode {
+    // set before state becomes Expanded, readers check state first
+    std::atomic<ParallelMctsEdge*> edges;
+    std::atomic<uint32_t> visitCount;
+    std::atomic<uint32_t> virtualLosses;
+    std::atomic<float> valueSum;
+    // from the view of the player to move, set before state becomes Terminal
+    float terminalValue;
+    uint16_t numEdges;
+    // a thread that turns New into Pending owns the expansion
+    std::atomic<NodeState> state;
+};
+
+// the counters for the shared search math of mcts.hpp, every counter is
+// loaded and updated on its own with relaxed order
+inline MctsStats loadStats(const ParallelMctsNode& node) {
+    constexpr auto relaxed = std::memory_order_relaxed;
+    return MctsStats{node.valueSum.load(relaxed), node.visitCount.load(relaxed),
+                     node.virtualLosses.load(relaxed)};
+}
+
+inline MctsStats loadStats(const ParallelMctsEdge& edge) {
+    constexpr auto relaxed = std::memory_order_relaxed;
+    return MctsStats{edge.valueSum.load(relaxed), edge.visitCount.load(relaxed),
+                     edge.virtualLosses.load(relaxed)};
+}
+
+template <typename T>
+inline void addAtomicVisit(T& stats, float value) {
+    constexpr auto relaxed = std::memory_order_relaxed;
+    stats.visitCount.fetch_add(1, relaxed);
+    stats.valueSum.fetch_add(value, relaxed);
+    stats.virtualLosses.fetch_sub(1, relaxed);
+}
+
+inline void addVisit(ParallelMctsNode& node, float value) {
+    addAtomicVisit(node, value);
+}
+
+inline void addVisit(ParallelMctsEdge& edge, float value) {
+    addAtomicVisit(edge, value);
+}
+
+inline void removeVirtualLoss(ParallelMctsNode& node) {
+    node.virtualLosses.fetch_sub(1, std::memory_order_relaxed);
+}
+
+inline void removeVirtualLoss(ParallelMctsEdge& edge) {
+    edge.virtualLosses.fetch_sub(1, std::memory_order_relaxed);
+}
+
+// a single search tree that is walked by many threads at once. every round
+// the threads select leavesPerRound leaves concurrently, the evaluator is
+// called once with all of them and the threads expand them and back the
+// values up concurrently again. the counters are atomics and children are
+// published with compare exchange, so there are no locks on the tree. every
+// leaf slot of a round has its own arena, a slot only runs on one thread at
+// a time so allocating from it needs no synchronization
+class ParallelMcts {
+   public:
+    ParallelMcts(const MctsConfig& config, size_t numThreads, uint64_t seed);
+
+    void reset(const GameState& state);
+    void advance(Action action);
+
+    // runs config.numSimulations simulations
+    void search(const MctsEvaluator& evaluate);
+
+    void getVisitCounts(float* counts) const;
+    float getRootValue() const;
+
+   private:
+    using ArenaSet = std::vector<Arena>;
+
+    // what a leaf slot found in a round
+    enum class SlotResult : uint8_t { Collision, BackedUp, Pending };
+
+    struct Slot {
+        SlotResult result;
+        std::vector<ParallelMctsNode*> nodes;
+        std::vector<ParallelMctsEdge*> edges;
+        MoveList moves;
+        bool isWhite;
+    };
+
+    ParallelMctsEdge* selectEdge(ParallelMctsNode& node) const;
+    void selectLeaf(size_t slot, GameState& state);
+    void runSlot(size_t slot, uint8_t* obs, uint8_t* mask);
+    void expand(size_t slot, const float* priors);
+    void addDirichletNoise(ParallelMctsNode& node);
+    void backup(const Slot& slot, float value);
+    void revertVirtualLoss(const Slot& slot);
+
+    MctsConfig config;
+    PlayoutRng rng;
+    ThreadPool pool;
+
+    GameState rootState;
+    ParallelMctsNode* root;
+    bool rootHasNoise = false;
+    // arenas[0] holds the tree, arenas[1] is the spare set for advance
+    std::array<ArenaSet, 2> arenas;
+
+    std::vector<Slot> slots;
+    std::vector<uint8_t> observations;
+    std::vector<uint8_t> masks;
+    std::vector<float> priors;
+    std::vector<float> values;
+    std::vector<float> noise;
+};
+
+inline ParallelMcts::ParallelMcts(const MctsConfig& config, size_t numThreads,
+                                  uint64_t seed)
+    : config(config),
+      rng(seed),
+      pool(numThreads),
+      slots(config.leavesPerRound) {
+    if (config.leavesPerRound == 0) {
+        throw std::runtime_error("Error: leavesPerRound has to be positive.");
+    }
+    for (ArenaSet& set : arenas) {
+        for (uint32_t i = 0; i < config.leavesPerRound; i++) {
+            set.emplace_back(1 << 16);
+        }
+    }
+    observations.resize(config.leavesPerRound * OBSERVATION_SPACE_SIZE);
+    masks.resize(config.leavesPerRound * ACTION_SPACE_SIZE);
+    priors.resize(config.leavesPerRound * ACTION_SPACE_SIZE);
+    values.resize(config.leavesPerRound);
+    reset(GameState());
+}
+
+inline void ParallelMcts::reset(const GameState& state) {
+    rootState = state;
+    for (Arena& arena : arenas[0]) arena.reset();
+    root = arenas[0][0].allocate<ParallelMctsNode>();
+    rootHasNoise = false;
+}
+
+// copies node and everything below it into arena, no search may run
+inline ParallelMctsNode* copySubtree(const ParallelMctsNode& node,
+                                     Arena& arena) {
+    ParallelMctsNode* copy = arena.allocate<ParallelMctsNode>();
+    copy->visitCount = node.visitCount.load();
+    copy->valueSum = node.valueSum.load();
+    copy->terminalValue = node.terminalValue;
+    copy->numEdges = node.numEdges;
+    copy->state = node.state.load();
+    if (node.state != NodeState::Expanded) return copy;
+
+    const ParallelMctsEdge* edges = node.edges.load();
+    ParallelMctsEdge* copiedEdges =
+        arena.allocate<ParallelMctsEdge>(node.numEdges);
+    for (uint16_t i = 0; i < node.numEdges; i++) {
+        copiedEdges[i].prior = edges[i].prior;
+        copiedEdges[i].valueSum = edges[i].valueSum.load();
+        copiedEdges[i].visitCount = edges[i].visitCount.load();
+        copiedEdges[i].action = edges[i].action;
+        const ParallelMctsNode* child = edges[i].child.load();
+        if (child) copiedEdges[i].child = copySubtree(*child, arena);
+    }
+    copy->edges = copiedEdges;
+    return copy;
+}
+
+inline void ParallelMcts::advance(Action action) {
+    const std::vector<Action> legal = getLegalActions(rootState);
+    if (std::find(legal.begin(), legal.end(), action) == legal.end()) {
+        throw std::runtime_error("Error: action " + std::to_string(action) +
+                                 " is not legal.");
+    }
+
+    const ParallelMctsNode* next = nullptr;
+    if (root->state == NodeState::Expanded) {
+        const ParallelMctsEdge* edges = root->edges.load();
+        for (uint16_t i = 0; i < root->numEdges; i++) {
+            if (edges[i].action == action) {
+                next = edges[i].child.load();
+                break;
+            }
+        }
+    }
+    for (Arena& arena : arenas[1]) arena.reset();
+    root = next ? copySubtree(*next, arenas[1][0])
+                : arenas[1][0].allocate<ParallelMctsNode>();
+    std::swap(arenas[0], arenas[1]);
+    rootHasNoise = false;
+    applyAction(rootState, action);
+}
+
+inline ParallelMctsEdge* ParallelMcts::selectEdge(
+    ParallelMctsNode& node) const {
+    return selectPuctEdge(loadStats(node),
+                          node.edges.load(std::memory_order_acquire),
+                          node.numEdges, config);
+}
+
+inline void ParallelMcts::selectLeaf(size_t slotIndex, GameState& state) {
+    Slot& slot = slots[slotIndex];
+    Arena& arena = arenas[0][slotIndex];
+    slot.nodes.clear();
+    slot.edges.clear();
+    state = rootState;
+
+    ParallelMctsNode* node = root;
+    node->virtualLosses.fetch_add(1, std::memory_order_relaxed);
+    slot.nodes.push_back(node);
+    while (node->state.load(std::memory_order_acquire) ==
+           NodeState::Expanded) {
+        ParallelMctsEdge* edge = selectEdge(*node);
+        edge->virtualLosses.fetch_add(1, std::memory_order_relaxed);
+
+        ParallelMctsNode* child = edge->child.load(std::memory_order_acquire);
+        if (!child) {
+            // another thread may publish its node first, then ours is left
+            // unused in the arena
+            ParallelMctsNode* newChild = arena.allocate<ParallelMctsNode>();
+            child = edge->child.compare_exchange_strong(
+                        child, newChild, std::memory_order_acq_rel)
+                        ? newChild
+                        : child;
+        }
+        node = child;
+        node->virtualLosses.fetch_add(1, std::memory_order_relaxed);
+        slot.edges.push_back(edge);
+        slot.nodes.push_back(node);
+        applyAction(state, edge->action);
+    }
+}
+
+// selects a leaf for slot and decides what to do with it, obs and mask are
+// the rows of the slot
+inline void ParallelMcts::runSlot(size_t slotIndex, uint8_t* obs,
+                                  uint8_t* mask) {
+    Slot& slot = slots[slotIndex];
+    GameState state;
+    selectLeaf(slotIndex, state);
+    ParallelMctsNode* node = slot.nodes.back();
+
+    NodeState expected = NodeState::New;
+    if (!node->state.compare_exchange_strong(expected, NodeState::Pending,
+                                             std::memory_order_acq_rel)) {
+        if (expected == NodeState::Terminal) {
+            backup(slot, node->terminalValue);
+            slot.result = SlotResult::BackedUp;
+        } else {
+            // another slot of this round owns the leaf
+            revertVirtualLoss(slot);
+            slot.result = SlotResult::Collision;
+        }
+        return;
+    }
+
+    const bool isWhite = state.status.isWhite;
+    const TerminationInfo term = getLeafMoves(state, slot.moves);
+    if (term.isTerminated) {
+        node->terminalValue = isWhite ? term.whiteReward : term.blackReward;
+        node->state.store(NodeState::Terminal, std::memory_order_release);
+        backup(slot, node->terminalValue);
+        slot.result = SlotResult::BackedUp;
+        return;
+    }
+
+    slot.isWhite = isWhite;
+    writeLeafObservation(state, slot.moves, obs, mask);
+    slot.result = SlotResult::Pending;
+}
+
+inline void ParallelMcts::expand(size_t slotIndex, const float* priors) {
+    Slot& slot = slots[slotIndex];
+    ParallelMctsNode& node = *slot.nodes.back();
+    ParallelMctsEdge* edges =
+        arenas[0][slotIndex].allocate<ParallelMctsEdge>(slot.moves.size());
+    initEdges(edges, slot.moves, slot.isWhite, priors);
+
+    node.numEdges = slot.moves.size();
+    node.edges.store(edges, std::memory_order_release);
+    node.state.store(NodeState::Expanded, std::memory_order_release);
+}
+
+inline void ParallelMcts::addDirichletNoise(ParallelMctsNode& node) {
+    mixDirichletNoise(node.edges.load(), node.numEdges, config, rng, noise);
+}
+
+inline void ParallelMcts::backup(const Slot& slot, float value) {
+    backupPath(slot.nodes, slot.edges, value);
+}
+
+inline void ParallelMcts::revertVirtualLoss(const Slot& slot) {
+    revertPathVirtualLoss(slot.nodes, slot.edges);
+}
+
+inline void ParallelMcts::search(const MctsEvaluator& evaluate) {
+    if (root->state == NodeState::Expanded && !rootHasNoise) {
+        addDirichletNoise(*root);
+        rootHasNoise = true;
+    }
+
+    uint32_t remaining = config.numSimulations;
+    std::vector<size_t> pendingSlots;
+    while (remaining > 0) {
+        const size_t numSlots =
+            std::min<size_t>(remaining, config.leavesPerRound);
+        pool.parallelFor(numSlots, [&](size_t i) {
+            runSlot(i, observations.data() + i * OBSERVATION_SPACE_SIZE,
+                    masks.data() + i * ACTION_SPACE_SIZE);
+        });
+
+        // the pending rows are moved to the front for the evaluator
+        pendingSlots.clear();
+        for (size_t i = 0; i < numSlots; i++) {
+            if (slots[i].result == SlotResult::Collision) continue;
+            remaining--;
+            if (slots[i].result != SlotResult::Pending) continue;
+            const size_t row = pendingSlots.size();
+            if (row != i) {
+                std::memcpy(observations.data() + row * OBSERVATION_SPACE_SIZE,
+                            observations.data() + i * OBSERVATION_SPACE_SIZE,
+                            OBSERVATION_SPACE_SIZE);
+                std::memcpy(masks.data() + row * ACTION_SPACE_SIZE,
+                            masks.data() + i * ACTION_SPACE_SIZE,
+                            ACTION_SPACE_SIZE);
+            }
+            pendingSlots.push_back(i);
+        }
+        if (pendingSlots.empty()) continue;
+
+        try {
+            evaluate(pendingSlots.size(), observations.data(), masks.data(),
+                     priors.data(), values.data());
+        } catch (...) {
+            for (const size_t i : pendingSlots) {
+                slots[i].nodes.back()->state = NodeState::New;
+                revertVirtualLoss(slots[i]);
+            }
+            throw;
+        }
+
+        pool.parallelFor(pendingSlots.size(), [&](size_t row) {
+            const size_t i = pendingSlots[row];
+            expand(i, priors.data() + row * ACTION_SPACE_SIZE);
+            backup(slots[i], values[row]);
+        });
+        if (root->state == NodeState::Expanded && !rootHasNoise) {
+            addDirichletNoise(*root);
+            rootHasNoise = true;
+        }
+    }
+}
+
+inline void ParallelMcts::getVisitCounts(float* counts) const {
+    if (root->state != NodeState::Expanded) {
+        std::fill_n(counts, ACTION_SPACE_SIZE, 0.0f);
+        return;
+    }
+    writeVisitCounts(root->edges.load(), root->numEdges, counts);
+}
+
+inline float ParallelMcts::getRootValue() const {
+    return getNodeValue(loadStats(*root));
+}
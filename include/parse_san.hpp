@@ -46,41 +46,33 @@ uint64_t sanToSquare(std::string squareSAN) {
 }
 
 template <bool isWhite>
-Moves getLegalMovesPerPiece(const GameState &state,
-                            const std::string pieceType) {
-    const Bitboard checkMask = Movegen::getCheckMask<isWhite>(state);
-    const Bitboard pinMaskHV = Movegen::getPinMaskHV<isWhite>(state);
-    const Bitboard pinMaskDG = Movegen::getPinMaskDG<isWhite>(state);
-    const Bitboard enemySeenSquares = Movegen::getSeenSquares<!isWhite>(state);
-    Moves moves;
+void getLegalMovesPerPiece(const GameState &state, const std::string pieceType,
+                           MoveList &moves) {
+    const Movegen::MoveGenContext ctx =
+        Movegen::createMoveGenContext<isWhite>(state);
+    Movegen::MoveListSink sink{moves};
     switch (pieceType[0]) {
         case 'R':
-            Movegen::getLegalRookMoves<isWhite>(state, checkMask, pinMaskHV,
-                                                pinMaskDG, moves);
+            Movegen::getLegalRookMoves<isWhite>(state, ctx, sink);
             break;
         case 'N':
-            Movegen::getLegalKnightMoves<isWhite>(state, checkMask, pinMaskHV,
-                                                  pinMaskDG, moves);
+            Movegen::getLegalKnightMoves<isWhite>(state, ctx, sink);
             break;
         case 'B':
-            Movegen::getLegalBishopMoves<isWhite>(state, checkMask, pinMaskHV,
-                                                  pinMaskDG, moves);
+            Movegen::getLegalBishopMoves<isWhite>(state, ctx, sink);
             break;
         case 'Q':
-            Movegen::getLegalQueenMoves<isWhite>(state, checkMask, pinMaskHV,
-                                                 pinMaskDG, moves);
+            Movegen::getLegalQueenMoves<isWhite>(state, ctx, sink);
             break;
         case 'K':
-            Movegen::getLegalKingMoves<isWhite>(state, enemySeenSquares, moves);
+            Movegen::getLegalKingMoves<isWhite>(state, ctx, sink);
             break;
         default:
-            Movegen::getLegalPawnMoves<isWhite>(state, checkMask, pinMaskHV,
-                                                pinMaskDG, moves);
+            Movegen::getLegalPawnMoves<isWhite>(state, ctx, sink);
             if (state.status.enpassant)
-                Movegen::getLegalEnpassantCaptures<isWhite>(state, moves);
+                Movegen::getLegalEnpassantCaptures<isWhite>(state, sink);
             break;
     }
-    return moves;
 }
 
 uint64_t getPromotionFlags(const char promoType) {
@@ -130,7 +122,8 @@ Move sanToMove(std::string san, const GameState &state) {
         match.str(3).empty() ? 0xffffffffffffffff : charToFile(match.str(2)[0]);
     const std::string pieceType = match.str(1);
 
-    Moves moves = getLegalMovesPerPiece<isWhite>(state, pieceType);
+    MoveList moves;
+    getLegalMovesPerPiece<isWhite>(state, pieceType, moves);
     Move validMove = 0ull;
     for (const Move &m : moves) {
         const uint64_t moveSource = m & 0b111111;
@@ -0,0 +1,277 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "game_state.hpp"
+#include "game_state_utils.hpp"
+#include "move_gen.hpp"
+#include "thread_pool.hpp"
+#include "types.hpp"
+#include "utils.hpp"
+
+// counts the leaves of the move tree below state at depth. the moves are
+// played with make/unmake on state itself and the last ply is only counted,
+// so this measures the move generation and nothing else. unlike the env it
+// doesn't stop at draws, the counts are the published ones
+template <bool isWhite>
+inline uint64_t perft(GameState& state, int depth) {
+    const Movegen::MoveGenContext ctx =
+        Movegen::createMoveGenContext<isWhite>(state);
+    if (depth == 1) return Movegen::countLegalMoves(state, ctx);
+
+    MoveList moves;
+    Movegen::getLegalMoves(state, ctx, moves);
+    uint64_t nodes = 0;
+    for (const Move move : moves) {
+        const UndoInfo undo =
+            makeMoveWithUndo<isWhite>(state, getMoveIndex<isWhite>(move));
+        nodes += perft<!isWhite>(state, depth - 1);
+        unmakeMove<isWhite>(state, undo);
+    }
+    return nodes;
+}
+
+inline uint64_t perft(GameState& state, int depth) {
+    if (depth <= 0) return 1;
+    return state.status.isWhite ? perft<true>(state, depth)
+                                : perft<false>(state, depth);
+}
+
+// fixed size table of subtree counts keyed by the zobrist key and the depth
+// that every thread can read and write without locks. an entry holds the key
+// xor the count next to the count, an entry that mixes two writes fails the
+// check and counts as a miss. newer entries always replace older ones
+class PerftTable {
+   public:
+    // the number of entries is the largest power of two that fits
+    explicit PerftTable(size_t sizeInMb) {
+        size_t numEntries = 1;
+        while (2 * numEntries * sizeof(Entry) <= (sizeInMb << 20)) {
+            numEntries *= 2;
+        }
+        entries.reset(new Entry[numEntries]);
+        mask = numEntries - 1;
+        clear();
+    }
+
+    bool probe(uint64_t hash, int depth, uint64_t& nodes) const {
+        const uint64_t key = getKey(hash, depth);
+        const Entry& entry = entries[key & mask];
+        const uint64_t check = entry.check.load(std::memory_order_relaxed);
+        nodes = entry.nodes.load(std::memory_order_relaxed);
+        return (check ^ nodes) == key;
+    }
+
+    void store(uint64_t hash, int depth, uint64_t nodes) {
+        const uint64_t key = getKey(hash, depth);
+        Entry& entry = entries[key & mask];
+        entry.check.store(key ^ nodes, std::memory_order_relaxed);
+        entry.nodes.store(nodes, std::memory_order_relaxed);
+    }
+
+    void clear() {
+        for (size_t i = 0; i <= mask; i++) {
+            // an empty entry only matches the key 0
+            entries[i].check.store(0, std::memory_order_relaxed);
+            entries[i].nodes.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    size_t size() const { return mask + 1; }
+
+   private:
+    struct Entry {
+        std::atomic<uint64_t> check;
+        std::atomic<uint64_t> nodes;
+    };
+
+    // the same position at another depth is another entry
+    static uint64_t getKey(uint64_t hash, int depth) {
+        return hash ^ (0x9e3779b97f4a7c15ull * (depth + 1));
+    }
+
+    std::unique_ptr<Entry[]> entries;
+    size_t mask;
+};
+
+// perft that looks up every subtree of depth 2 or more in table first, the
+// moves that transpose into a counted subtree don't walk it again
+template <bool isWhite>
+inline uint64_t perft(GameState& state, int depth, PerftTable& table) {
+    if (depth == 1) return perft<isWhite>(state, depth);
+
+    uint64_t nodes;
+    if (table.probe(state.positionHash, depth, nodes)) return nodes;
+
+    MoveList moves;
+    Movegen::getLegalMoves(state, Movegen::createMoveGenContext<isWhite>(state),
+                           moves);
+    nodes = 0;
+    for (const Move move : moves) {
+        const UndoInfo undo =
+            makeMoveWithUndo<isWhite>(state, getMoveIndex<isWhite>(move));
+        nodes += perft<!isWhite>(state, depth - 1, table);
+        unmakeMove<isWhite>(state, undo);
+    }
+    table.store(state.positionHash, depth, nodes);
+    return nodes;
+}
+
+// the table is optional
+inline uint64_t perft(GameState& state, int depth, PerftTable* table) {
+    if (!table) return perft(state, depth);
+    if (depth <= 0) return 1;
+    return state.status.isWhite ? perft<true>(state, depth, *table)
+                                : perft<false>(state, depth, *table);
+}
+
+// a root move and the leaves below it
+struct PerftDivide {
+    Move move;
+    uint64_t nodes;
+};
+
+// perft split up by the moves of the root, depth has to be at least 1
+inline std::vector<PerftDivide> perftDivide(GameState& state, int depth,
+                                            PerftTable* table = nullptr) {
+    MoveList moves;
+    Movegen::getLegalMoves(state, moves);
+    std::vector<PerftDivide> result;
+    result.reserve(moves.size());
+    for (const Move move : moves) {
+        uint64_t nodes;
+        if (state.status.isWhite) {
+            const UndoInfo undo =
+                makeMoveWithUndo<true>(state, getMoveIndex<true>(move));
+            nodes = perft(state, depth - 1, table);
+            unmakeMove<true>(state, undo);
+        } else {
+            const UndoInfo undo =
+                makeMoveWithUndo<false>(state, getMoveIndex<false>(move));
+            nodes = perft(state, depth - 1, table);
+            unmakeMove<false>(state, undo);
+        }
+        result.push_back(PerftDivide{move, nodes});
+    }
+    return result;
+}
+
+inline void playPerftMove(GameState& state, Move move) {
+    if (state.status.isWhite)
+        makeMove<true>(state, getMoveIndex<true>(move));
+    else
+        makeMove<false>(state, getMoveIndex<false>(move));
+}
+
+// perftDivide with the work spread over pool. the positions after the first
+// two plies are the work items, there are enough of them to keep every
+// thread busy even if one root move has most of the nodes. the threads can
+// share a table
+inline std::vector<PerftDivide> perftDivide(const GameState& state, int depth,
+                                            ThreadPool& pool,
+                                            PerftTable* table = nullptr) {
+    if (depth < 3) {
+        GameState copy = state;
+        return perftDivide(copy, depth, table);
+    }
+
+    struct WorkItem {
+        size_t rootIndex;
+        GameState state;
+    };
+    MoveList rootMoves;
+    Movegen::getLegalMoves(state, rootMoves);
+    std::vector<WorkItem> items;
+    for (uint32_t i = 0; i < rootMoves.size(); i++) {
+        GameState child = state;
+        playPerftMove(child, rootMoves[i]);
+        MoveList replies;
+        Movegen::getLegalMoves(child, replies);
+        for (const Move reply : replies) {
+            items.push_back(WorkItem{i, child});
+            playPerftMove(items.back().state, reply);
+        }
+    }
+
+    std::vector<uint64_t> counts(items.size());
+    pool.parallelFor(items.size(), [&](size_t i) {
+        counts[i] = perft(items[i].state, depth - 2, table);
+    });
+
+    std::vector<PerftDivide> result(rootMoves.size());
+    for (uint32_t i = 0; i < rootMoves.size(); i++) {
+        result[i] = PerftDivide{rootMoves[i], 0};
+    }
+    for (size_t i = 0; i < items.size(); i++) {
+        result[items[i].rootIndex].nodes += counts[i];
+    }
+    return result;
+}
+
+// the move in uci notation like e2e4 or e7e8q
+inline std::string moveToUci(Move move) {
+    const uint64_t flags = (move >> 12) & 0b1111;
+    std::string uci = squareToFenPos(move & 0b111111) +
+                      squareToFenPos((move >> 6) & 0b111111);
+    // the low bits of a promotion are knight, bishop, rook or queen
+    if (flags >= 0b1000) uci += "nbrq"[flags & 0b0011];
+    return uci;
+}
+
+// a position with a known perft count
+struct PerftPosition {
+    const char* name;
+    const char* fen;
+    int depth;
+    uint64_t nodes;
+};
+
+// the positions of the chessprogramming wiki and a few of the edge cases
+// collected by Martin Sedlak
+inline const std::vector<PerftPosition>& getPerftSuite() {
+    static const std::vector<PerftPosition> suite = {
+        {"start", "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+         5, 4865609},
+        {"start", "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+         6, 119060324},
+        {"kiwipete",
+         "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+         4, 4085603},
+        {"kiwipete",
+         "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+         5, 193690690},
+        {"position 3", "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 6,
+         11030083},
+        {"position 4",
+         "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", 5,
+         15833292},
+        {"position 5",
+         "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8", 5,
+         89941194},
+        {"position 6",
+         "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - "
+         "0 10",
+         5, 164075551},
+        {"illegal enpassant through a pin", "3k4/3p4/8/K1P4r/8/8/8/8 b - - 0 1",
+         6, 1134888},
+        {"enpassant capture gives check", "8/8/1k6/2b5/2pP4/8/5K2/8 b - d3 0 1",
+         6, 1440467},
+        {"short castling gives check", "5k2/8/8/8/8/8/8/4K2R w K - 0 1", 6,
+         661072},
+        {"long castling gives check", "3k4/8/8/8/8/8/8/R3K3 w Q - 0 1", 6,
+         803711},
+        {"promote out of check", "2K2r2/4P3/8/8/8/8/8/3k4 w - - 0 1", 6,
+         3821001},
+        {"promote to give check", "4k3/1P6/8/8/8/8/K7/8 w - - 0 1", 6,
+         217342},
+        {"underpromote to check", "8/P1k5/K7/8/8/8/8/8 w - - 0 1", 6, 92683},
+        {"self stalemate", "K1k5/8/P7/8/8/8/8/8 w - - 0 1", 6, 2217},
+        {"stalemate and checkmate", "8/k1P5/8/1K6/8/8/8/8 w - - 0 1", 7,
+         567584},
+    };
+    return suite;
+}
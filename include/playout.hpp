@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "game_rules.hpp"
+#include "game_state.hpp"
+#include "game_state_utils.hpp"
+#include "move_gen.hpp"
+#include "thread_pool.hpp"
+#include "types.hpp"
+
+// splitmix64, small and fast enough that drawing the moves doesn't show up
+// next to the move generation. it can be used with the <random>
+// distributions as well
+struct PlayoutRng {
+    using result_type = uint64_t;
+
+    uint64_t state;
+
+    explicit PlayoutRng(uint64_t seed) : state(seed) {}
+
+    static constexpr uint64_t min() { return 0; }
+    static constexpr uint64_t max() { return UINT64_MAX; }
+
+    uint64_t operator()() {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+};
+
+// index in [0, n) from the high bits of a random number, the bias is far
+// below anything a playout could notice
+template <typename Rng>
+inline uint32_t randomIndex(Rng& rng, uint32_t n) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(rng() >> 32)) * n) >>
+           32;
+}
+
+struct PlayoutResult {
+    int32_t whiteReward;
+    int32_t blackReward;
+    // false if the game was stopped by maxPlies
+    bool isTerminated;
+    uint32_t plies;
+};
+
+// plays one random move, returns true and sets result instead if the game
+// is already over. the rules are the ones of checkForTermination but the
+// legal moves are only generated once
+template <bool isWhite, typename Rng>
+inline bool playoutStep(GameState& state, Rng& rng, PlayoutResult& result,
+                        std::vector<Action>* actions) {
+    const Movegen::MoveGenContext ctx =
+        Movegen::createMoveGenContext<isWhite>(state);
+    MoveList moves;
+    Movegen::getLegalMoves(state, ctx, moves);
+
+    if (moves.empty()) {
+        if (ctx.enemySeenSquares & getKing<isWhite>(state)) {
+            result.whiteReward = isWhite ? -1 : 1;
+            result.blackReward = isWhite ? 1 : -1;
+        }
+        result.isTerminated = true;
+        return true;
+    }
+    if (isDrawBy50Moves(state) || isDrawBy3FoldRepetition<isWhite>(state) ||
+        isInsufficientMaterial(state) ||
+        state.fullMoveCount == (MAX_GAME_LENGTH + 1)) {
+        result.isTerminated = true;
+        return true;
+    }
+
+    const Move move = moves[randomIndex(rng, moves.size())];
+    const Action action = getMoveIndex<isWhite>(move);
+    if (actions) actions->push_back(action);
+
+    // only the repetition keys are kept, the past boards are only needed by
+    // the observation
+    state.positionHashes.push(state.positionHash);
+    makeMove<isWhite>(state, action);
+    return false;
+}
+
+// plays uniformly random legal moves from state until the game ends or
+// maxPlies moves were made, the actions are appended to actions if given
+template <typename Rng>
+inline PlayoutResult playout(GameState state, Rng& rng, uint32_t maxPlies,
+                             std::vector<Action>* actions = nullptr) {
+    PlayoutResult result{0, 0, false, 0};
+    for (; result.plies < maxPlies; result.plies++) {
+        const bool isOver =
+            state.status.isWhite
+                ? playoutStep<true>(state, rng, result, actions)
+                : playoutStep<false>(state, rng, result, actions);
+        if (isOver) return result;
+    }
+    return result;
+}
+
+// numGames playouts from start, game i uses the seed seed + i so the results
+// don't depend on the number of threads. actions can be null, otherwise it
+// gets the actions of every game
+inline void playoutBatch(const GameState& start, uint64_t seed,
+                         size_t numGames, uint32_t maxPlies,
+                         PlayoutResult* results,
+                         std::vector<std::vector<Action>>* actions,
+                         ThreadPool* pool = nullptr) {
+    if (actions) actions->assign(numGames, {});
+    const auto playGame = [&](size_t i) {
+        PlayoutRng rng(seed + i);
+        results[i] = playout(start, rng, maxPlies,
+                             actions ? &(*actions)[i] : nullptr);
+    };
+    if (pool) {
+        pool->parallelFor(numGames, playGame);
+    } else {
+        for (size_t i = 0; i < numGames; i++) playGame(i);
+    }
+}
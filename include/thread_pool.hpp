@@ -0,0 +1,194 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// fixed set of worker threads that run parallel loops. every worker starts
+// with an equal share of the indices and once it runs out it steals half of
+// the remaining indices of another worker, so a few expensive positions
+// don't leave the other threads idle. only one thread may call parallelFor
+// at a time
+class ThreadPool {
+   public:
+    explicit ThreadPool(size_t numThreads, bool pinThreads = false);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const { return workers.size(); }
+
+    // calls body(i) for every i in [0, count) and blocks until all calls
+    // returned, the first exception thrown by body is rethrown here
+    template <typename Body>
+    void parallelFor(size_t count, Body&& body);
+
+   private:
+    // the indices [begin, end) a worker still has to process, the owner
+    // takes from the front and thieves from the back
+    struct alignas(64) WorkQueue {
+        std::mutex mutex;
+        size_t begin = 0;
+        size_t end = 0;
+    };
+
+    bool popIndex(size_t worker, size_t& index);
+    bool stealIndices(size_t worker);
+    void runJob(size_t worker);
+    void workerLoop(size_t worker, bool pinThread);
+
+    std::vector<std::thread> workers;
+    std::unique_ptr<WorkQueue[]> queues;
+
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    std::condition_variable finished;
+    uint64_t generation = 0;
+    size_t activeWorkers = 0;
+    bool stopping = false;
+
+    // the body of the current parallelFor without its type
+    void (*job)(void*, size_t) = nullptr;
+    void* jobContext = nullptr;
+    std::exception_ptr error;
+};
+
+inline ThreadPool::ThreadPool(size_t numThreads, bool pinThreads)
+    : queues(new WorkQueue[numThreads]) {
+    workers.reserve(numThreads);
+    for (size_t i = 0; i < numThreads; i++) {
+        workers.emplace_back(&ThreadPool::workerLoop, this, i, pinThreads);
+    }
+}
+
+inline ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wakeUp.notify_all();
+    for (std::thread& worker : workers) worker.join();
+}
+
+template <typename Body>
+void ThreadPool::parallelFor(size_t count, Body&& body) {
+    if (count == 0) return;
+    if (workers.empty()) {
+        for (size_t i = 0; i < count; i++) body(i);
+        return;
+    }
+
+    using BodyType = std::remove_reference_t<Body>;
+    const size_t numWorkers = workers.size();
+    for (size_t i = 0; i < numWorkers; i++) {
+        std::lock_guard<std::mutex> lock(queues[i].mutex);
+        queues[i].begin = count * i / numWorkers;
+        queues[i].end = count * (i + 1) / numWorkers;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    job = [](void* context, size_t index) {
+        (*static_cast<BodyType*>(context))(index);
+    };
+    jobContext = const_cast<void*>(static_cast<const void*>(&body));
+    error = nullptr;
+    activeWorkers = numWorkers;
+    generation++;
+    wakeUp.notify_all();
+    finished.wait(lock, [this] { return activeWorkers == 0; });
+
+    if (error) std::rethrow_exception(std::exchange(error, nullptr));
+}
+
+inline bool ThreadPool::popIndex(size_t worker, size_t& index) {
+    WorkQueue& queue = queues[worker];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.begin == queue.end) return false;
+    index = queue.begin++;
+    return true;
+}
+
+// moves half of the indices of the first worker that has some left into the
+// queue of worker, returns false once every queue is empty
+inline bool ThreadPool::stealIndices(size_t worker) {
+    const size_t numWorkers = workers.size();
+    for (size_t offset = 1; offset < numWorkers; offset++) {
+        WorkQueue& victim = queues[(worker + offset) % numWorkers];
+        size_t begin, end;
+        {
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            const size_t remaining = victim.end - victim.begin;
+            if (remaining == 0) continue;
+            end = victim.end;
+            begin = end - (remaining + 1) / 2;
+            victim.end = begin;
+        }
+        std::lock_guard<std::mutex> lock(queues[worker].mutex);
+        queues[worker].begin = begin;
+        queues[worker].end = end;
+        return true;
+    }
+    return false;
+}
+
+inline void ThreadPool::runJob(size_t worker) {
+    size_t index;
+    while (true) {
+        if (!popIndex(worker, index)) {
+            if (!stealIndices(worker)) return;
+            continue;
+        }
+        try {
+            job(jobContext, index);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!error) error = std::current_exception();
+        }
+    }
+}
+
+inline void ThreadPool::workerLoop(size_t worker, bool pinThread) {
+#ifdef __linux__
+    if (pinThread) {
+        const unsigned numCores =
+            std::max(1u, std::thread::hardware_concurrency());
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(worker % numCores, &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+#else
+    (void)pinThread;
+#endif
+
+    uint64_t seenGeneration = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeUp.wait(lock, [&] {
+                return stopping || generation != seenGeneration;
+            });
+            if (stopping) return;
+            seenGeneration = generation;
+        }
+
+        runJob(worker);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--activeWorkers == 0) finished.notify_one();
+    }
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <array>
 #include <deque>
 #include <stdint.h>
 #include <vector>
@@ -9,6 +10,32 @@ using Move = uint16_t;
 using Moves = std::vector<Move>;
 using Action = uint64_t;
 
+// no legal chess position has more than 218 moves
+constexpr uint32_t MAX_MOVES = 256;
+
+// fixed capacity move list that lives on the stack, it is used by the move
+// generation to avoid allocating a std::vector for every position
+struct MoveList {
+    std::array<Move, MAX_MOVES> moves;
+    uint32_t count;
+
+    MoveList() : count(0) {}
+
+    void push_back(Move move) { moves[count++] = move; }
+    void clear() { count = 0; }
+
+    uint32_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    Move &operator[](uint32_t index) { return moves[index]; }
+    const Move &operator[](uint32_t index) const { return moves[index]; }
+
+    Move *begin() { return moves.data(); }
+    Move *end() { return moves.data() + count; }
+    const Move *begin() const { return moves.data(); }
+    const Move *end() const { return moves.data() + count; }
+};
+
 enum class PieceType : uint8_t {
   Pawn,
   Knight,
@@ -7,8 +7,9 @@
 
 namespace Zobrist {
 
+// 12 piece types (white pawn, rook, knight, bishop, queen, king and then the
+// same for black) on 64 squares
 constexpr uint64_t numPiecePositionColorElements = 768;
-constexpr uint64_t blackOffset = 384;  // (768 / 2)
 constexpr uint64_t movingColorOffset = numPiecePositionColorElements;
 constexpr uint64_t castlingOffset = numPiecePositionColorElements + 2;
 constexpr uint64_t enpassantOffset = castlingOffset + 4;
@@ -27,7 +28,8 @@ constexpr uint64_t rand64(uint64_t n) {
 constexpr std::array<uint64_t, 790> preCalcZobrist() {
     std::array<uint64_t, 790> res;
     for (uint64_t i = 0; i < 790; ++i) {
-        res[i] = rand64(i);
+        // the mixer needs a non-zero seed
+        res[i] = rand64(i + 1);
     }
     return res;
 }
@@ -35,14 +37,14 @@ constexpr std::array<uint64_t, 790> preCalcZobrist() {
 constexpr std::array<uint64_t, 790> zobristLookup = preCalcZobrist();
 
 template <bool isWhite>
-uint64_t hashMovingColor() {
+inline uint64_t hashMovingColor() {
     if constexpr (isWhite)
         return zobristLookup[movingColorOffset];
     else
         return zobristLookup[movingColorOffset + 1];
 }
 
-uint64_t hashCastlingRights(const GameState& state) {
+inline uint64_t hashCastlingRights(const GameState& state) {
     uint64_t hash = 0ull;
     const GameStatus status = state.status;
     if (status.wKingC) {
@@ -60,17 +62,11 @@ uint64_t hashCastlingRights(const GameState& state) {
     return hash;
 }
 
-template <bool isWhite>
 inline uint64_t getPieceIndex(uint64_t typeIndex, uint64_t square) {
-    if constexpr (isWhite) {
-        return typeIndex * 64 + square;
-    } else {
-        return typeIndex * 64 + square + blackOffset;
-    }
+    return typeIndex * 64 + square;
 }
 
-template <bool isWhite>
-uint64_t hashPieces(const GameState& state) {
+inline uint64_t hashPieces(const GameState& state) {
     Bitboard w_pawn = state.w_pawn;
     Bitboard w_rook = state.w_rook;
     Bitboard w_knight = state.w_knight;
@@ -88,80 +84,80 @@ uint64_t hashPieces(const GameState& state) {
     uint64_t hash = 0ull;
     Bitloop(w_pawn) {
         const uint64_t square = SquareOf(w_pawn);
-        const uint64_t index = getPieceIndex<isWhite>(0ull, square);
+        const uint64_t index = getPieceIndex(0ull, square);
         hash ^= zobristLookup[index];
     }
 
     Bitloop(w_rook) {
         const uint64_t square = SquareOf(w_rook);
-        const uint64_t index = getPieceIndex<isWhite>(1ull, square);
+        const uint64_t index = getPieceIndex(1ull, square);
         hash ^= zobristLookup[index];
     }
 
     Bitloop(w_knight) {
         const uint64_t square = SquareOf(w_knight);
-        const uint64_t index = getPieceIndex<isWhite>(2ull, square);
+        const uint64_t index = getPieceIndex(2ull, square);
         hash ^= zobristLookup[index];
     }
 
     Bitloop(w_bishop) {
         const uint64_t square = SquareOf(w_bishop);
-        const uint64_t index = getPieceIndex<isWhite>(3ull, square);
+        const uint64_t index = getPieceIndex(3ull, square);
         hash ^= zobristLookup[index];
     }
 
     Bitloop(w_queen) {
         const uint64_t square = SquareOf(w_queen);
-        const uint64_t index = getPieceIndex<isWhite>(4ull, square);
+        const uint64_t index = getPieceIndex(4ull, square);
         hash ^= zobristLookup[index];
     }
 
     Bitloop(w_king) {
         const uint64_t square = SquareOf(w_king);
-        const uint64_t index = getPieceIndex<isWhite>(5ull, square);
+        const uint64_t index = getPieceIndex(5ull, square);
         hash ^= zobristLookup[index];
     }
 
     Bitloop(b_pawn) {
         const uint64_t square = SquareOf(b_pawn);
-        const uint64_t index = getPieceIndex<isWhite>(6ull, square);
+        const uint64_t index = getPieceIndex(6ull, square);
         hash ^= zobristLookup[index];
     }
 
     Bitloop(b_rook) {
         const uint64_t square = SquareOf(b_rook);
-        const uint64_t index = getPieceIndex<isWhite>(7ull, square);
+        const uint64_t index = getPieceIndex(7ull, square);
         hash ^= zobristLookup[index];
     }
 
     Bitloop(b_knight) {
         const uint64_t square = SquareOf(b_knight);
-        const uint64_t index = getPieceIndex<isWhite>(8ull, square);
+        const uint64_t index = getPieceIndex(8ull, square);
         hash ^= zobristLookup[index];
     }
 
     Bitloop(b_bishop) {
         const uint64_t square = SquareOf(b_bishop);
-        const uint64_t index = getPieceIndex<isWhite>(9ull, square);
+        const uint64_t index = getPieceIndex(9ull, square);
         hash ^= zobristLookup[index];
     }
 
     Bitloop(b_queen) {
         const uint64_t square = SquareOf(b_queen);
-        const uint64_t index = getPieceIndex<isWhite>(10ull, square);
+        const uint64_t index = getPieceIndex(10ull, square);
         hash ^= zobristLookup[index];
     }
 
     Bitloop(b_king) {
         const uint64_t square = SquareOf(b_king);
-        const uint64_t index = getPieceIndex<isWhite>(11ull, square);
+        const uint64_t index = getPieceIndex(11ull, square);
         hash ^= zobristLookup[index];
     }
     return hash;
 }
 
 template <bool isWhite>
-uint64_t hashEnpassant(const GameState& state) {
+inline uint64_t hashEnpassant(const GameState& state) {
     // if there is an enpassant pawn calculate index [0, 16)
     if (state.status.enpassant) {
         const Bitboard enpassant = state.enpassant_board;
@@ -177,13 +173,31 @@ uint64_t hashEnpassant(const GameState& state) {
 }
 
 template <bool isWhite>
-uint64_t hashBoard(const GameState& state) {
+inline uint64_t hashBoard(const GameState& state) {
     uint64_t hash = 0ull;
     hash ^= hashMovingColor<isWhite>();
     hash ^= hashCastlingRights(state);
-    hash ^= hashPieces<isWhite>(state);
+    hash ^= hashPieces(state);
     hash ^= hashEnpassant<isWhite>(state);
     return hash;
 }
 
+// the keys below are used to update GameState::positionHash after every move
+// instead of hashing the whole board again
+
+template <bool isWhite>
+inline uint64_t hashPiece(PieceType type, uint64_t square) {
+    // PieceType is ordered pawn, knight, bishop, rook, queen, king but the
+    // keys are ordered pawn, rook, knight, bishop, queen, king
+    constexpr std::array<uint64_t, 6> typeIndices = {0, 2, 3, 1, 4, 5};
+    const uint64_t colorOffset = isWhite ? 0 : 6;
+    const uint64_t typeIndex =
+        typeIndices[static_cast<uint64_t>(type)] + colorOffset;
+    return zobristLookup[getPieceIndex(typeIndex, square)];
+}
+
+inline uint64_t hashNextPlayer() {
+    return hashMovingColor<true>() ^ hashMovingColor<false>();
+}
+
 }  // namespace Zobrist
@@ -0,0 +1,234 @@
+"""End to end throughput of random self play through the python module.
+
+Plays uniformly random games with a single ChessGameEnv, with a
+BatchedChessEnv driven from python and with the loop of BatchedChessEnv that
+runs without python in between, and prints steps/sec, observes/sec and
+games/sec for each.
+
+The results are compared against a baseline file. The script exits with 1 if
+the steps or observes per second of a benchmark dropped by more than
+--max-regression percent, and also if the baseline or an entry of it is
+missing unless --allow-missing-baseline is given. Run it once with
+--update-baseline on the machine that gates to write the baseline.
+"""
+
+import argparse
+import json
+import os
+import sys
+import time
+
+import numpy as np
+
+try:
+    import chess_env
+except ImportError:
+    import _chess_env as chess_env
+
+OBSERVATION_SPACE_SIZE = 7104
+ACTION_SPACE_SIZE = 4672
+DEFAULT_BASELINE = os.path.join(
+    os.path.dirname(os.path.abspath(__file__)), "throughput_baseline.json"
+)
+# games/sec is too noisy in short runs to gate on
+GATED_METRICS = ["steps_per_sec", "observes_per_sec"]
+
+
+class Counter:
+    """Counts the work of a benchmark until min_time has passed."""
+
+    def __init__(self, min_time):
+        self.min_time = min_time
+        self.steps = 0
+        self.observes = 0
+        self.games = 0
+        self.start = time.perf_counter()
+        self.seconds = 0.0
+
+    def running(self):
+        self.seconds = time.perf_counter() - self.start
+        return self.seconds < self.min_time
+
+    def result(self):
+        return {
+            "steps_per_sec": self.steps / self.seconds,
+            "observes_per_sec": self.observes / self.seconds,
+            "games_per_sec": self.games / self.seconds,
+        }
+
+
+def bench_single(args, rng):
+    """observe returns a new observation object every step."""
+    env = chess_env.ChessGameEnv()
+    counter = Counter(args.min_time)
+    while counter.running():
+        for _ in range(100):
+            obs = env.observe()
+            counter.observes += 1
+            if obs.isTerminated:
+                counter.games += 1
+                env = chess_env.ChessGameEnv()
+                continue
+            legal = obs.actionMask.nonzero()[0]
+            env.step(int(legal[rng.integers(len(legal))]))
+            counter.steps += 1
+    return counter.result()
+
+
+def bench_single_into(args, rng):
+    """observe_into writes into buffers that are reused every step."""
+    env = chess_env.ChessGameEnv()
+    obs = np.zeros(OBSERVATION_SPACE_SIZE, dtype=np.uint8)
+    mask = np.zeros(ACTION_SPACE_SIZE, dtype=np.uint8)
+    counter = Counter(args.min_time)
+    while counter.running():
+        for _ in range(100):
+            _, _, terminated = env.observe_into(obs, mask)
+            counter.observes += 1
+            if terminated:
+                counter.games += 1
+                env = chess_env.ChessGameEnv()
+                continue
+            legal = mask.nonzero()[0]
+            env.step(int(legal[rng.integers(len(legal))]))
+            counter.steps += 1
+    return counter.result()
+
+
+def bench_batched(args, rng):
+    """The loop of a vectorized worker, the actions are picked with numpy."""
+    n = args.num_envs
+    env = chess_env.BatchedChessEnv(n, args.threads)
+    obs = np.zeros((n, OBSERVATION_SPACE_SIZE), dtype=np.uint8)
+    mask = np.zeros((n, ACTION_SPACE_SIZE), dtype=np.uint8)
+    rewards = np.zeros((n, 2), dtype=np.int32)
+    done = np.zeros(n, dtype=np.uint8)
+    counter = Counter(args.min_time)
+    while counter.running():
+        for _ in range(10):
+            env.observe_into(obs, mask, rewards, done)
+            counter.observes += n
+            finished = done.nonzero()[0]
+            if len(finished):
+                counter.games += len(finished)
+                for i in finished:
+                    env.reset(int(i))
+                env.observe_into(obs, mask, rewards, done)
+                counter.observes += n
+            # a random legal action per game: the largest noise on the mask
+            actions = np.argmax(mask * rng.random(mask.shape), axis=1)
+            env.step(actions.astype(np.uint64))
+            counter.steps += n
+    return counter.result()
+
+
+def bench_native(args, rng):
+    """The same loop as bench_batched without python between the steps."""
+    n = args.num_envs
+    env = chess_env.BatchedChessEnv(n, args.threads)
+    steps_per_call = 50
+    counter = Counter(args.min_time)
+    while counter.running():
+        seed = int(rng.integers(2**63))
+        counter.games += env.random_self_play(seed, steps_per_call)
+        counter.steps += n * steps_per_call
+        counter.observes += n * steps_per_call
+    return counter.result()
+
+
+BENCHMARKS = {
+    "single": bench_single,
+    "single_into": bench_single_into,
+    "batched": bench_batched,
+    "native": bench_native,
+}
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--min-time", type=float, default=3.0,
+                        help="seconds every benchmark runs")
+    parser.add_argument("--num-envs", type=int, default=64,
+                        help="games of the batched benchmarks")
+    parser.add_argument("--threads", type=int, default=1,
+                        help="threads of the batched benchmarks")
+    parser.add_argument("--seed", type=int, default=0)
+    parser.add_argument("--filter", default="",
+                        help="only run the benchmarks whose name contains this")
+    parser.add_argument("--baseline", default=DEFAULT_BASELINE,
+                        help="json file with the results to compare against")
+    parser.add_argument("--update-baseline", action="store_true",
+                        help="write the results to the baseline file")
+    parser.add_argument("--max-regression", type=float, default=10.0,
+                        help="allowed drop in percent before the run fails")
+    parser.add_argument("--allow-missing-baseline", action="store_true",
+                        help="don't fail if there is nothing to compare to")
+    return parser.parse_args()
+
+
+def compare(results, baseline, max_regression):
+    """Prints the change against the baseline.
+
+    Returns the regressions and the metrics the baseline has no usable
+    value for.
+    """
+    regressions = []
+    missing = []
+    for name, result in results.items():
+        for metric in GATED_METRICS:
+            old = baseline.get(name, {}).get(metric)
+            if not isinstance(old, (int, float)) or old <= 0:
+                missing.append(f"{name} {metric} has no positive value in "
+                               f"the baseline")
+                continue
+            change = 100.0 * (result[metric] - old) / old
+            print(f"{name} {metric}: {change:+.1f}%")
+            if change < -max_regression:
+                regressions.append(f"{name} {metric} dropped by {-change:.1f}%")
+    return regressions, missing
+
+
+def main():
+    args = parse_args()
+    rng = np.random.default_rng(args.seed)
+    results = {}
+    print(f"{'benchmark':<14}{'steps/sec':>14}{'observes/sec':>16}"
+          f"{'games/sec':>12}")
+    for name, bench in BENCHMARKS.items():
+        if args.filter not in name:
+            continue
+        result = bench(args, rng)
+        results[name] = result
+        print(f"{name:<14}{result['steps_per_sec']:>14.0f}"
+              f"{result['observes_per_sec']:>16.0f}"
+              f"{result['games_per_sec']:>12.2f}")
+
+    if args.update_baseline:
+        baseline = {}
+        if os.path.exists(args.baseline):
+            with open(args.baseline) as f:
+                baseline = json.load(f)
+        baseline.update(results)
+        with open(args.baseline, "w") as f:
+            json.dump(baseline, f, indent=2)
+        print(f"wrote {args.baseline}")
+        return 0
+
+    if not os.path.exists(args.baseline):
+        print(f"MISSING no baseline at {args.baseline}, run with "
+              f"--update-baseline first")
+        return 0 if args.allow_missing_baseline else 1
+    with open(args.baseline) as f:
+        baseline = json.load(f)
+    regressions, missing = compare(results, baseline, args.max_regression)
+    for entry in missing:
+        print(f"MISSING {entry}, run with --update-baseline")
+    for regression in regressions:
+        print(f"REGRESSION {regression}")
+    if missing and not args.allow_missing_baseline:
+        return 1
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
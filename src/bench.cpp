@@ -0,0 +1,280 @@
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "game_env.hpp"
+#include "perft.hpp"
+#include "playout.hpp"
+#include "zobrist.hpp"
+
+// usage: bench [--filter TEXT] [--min-time SECONDS] [--json PATH]
+//
+// times the stages of the hot path one by one over a fixed corpus of
+// positions and prints ns/op and ops/sec for each. --filter only runs the
+// benchmarks whose name contains TEXT and --json writes the results to PATH
+struct BenchOptions {
+    std::string filter;
+    std::string jsonPath;
+    double minTime = 0.5;
+};
+
+BenchOptions parseOptions(int argc, char** argv) {
+    BenchOptions options;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        const auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                throw std::runtime_error("Error: " + arg + " needs a value.");
+            }
+            return argv[++i];
+        };
+        if (arg == "--filter") {
+            options.filter = value();
+        } else if (arg == "--min-time") {
+            options.minTime = std::stod(value());
+        } else if (arg == "--json") {
+            options.jsonPath = value();
+        } else {
+            throw std::runtime_error("Error: unknown argument " + arg + ".");
+        }
+    }
+    return options;
+}
+
+// a position of the corpus with everything the benchmarks need prepared
+struct CorpusEntry {
+    ChessGameEnv env;
+    GameState state;
+    std::string fen;
+    std::vector<Move> moves;
+    Bitboard checkMask;
+};
+
+// the positions of the perft suite and every 4th position of a few seeded
+// random games, the games keep their history so the observation has past
+// boards and repetitions like in self play
+std::vector<CorpusEntry> createCorpus() {
+    std::vector<CorpusEntry> corpus;
+    const auto addPosition = [&](const ChessGameEnv& env) {
+        const GameState state = env.getState();
+        const Bitboard checkMask =
+            state.status.isWhite ? Movegen::getCheckMask<true>(state)
+                                 : Movegen::getCheckMask<false>(state);
+        corpus.push_back(CorpusEntry{env, state, generateFEN(state),
+                                     env.getPossibleMoves(), checkMask});
+    };
+
+    for (const PerftPosition& position : getPerftSuite()) {
+        if (corpus.empty() || corpus.back().fen != position.fen) {
+            addPosition(ChessGameEnv(position.fen));
+        }
+    }
+
+    constexpr uint64_t numGames = 16;
+    constexpr uint32_t maxPlies = 160;
+    for (uint64_t seed = 0; seed < numGames; seed++) {
+        PlayoutRng rng(seed);
+        ChessGameEnv env;
+        for (uint32_t ply = 0; ply < maxPlies; ply++) {
+            const Moves moves = env.getPossibleMoves();
+            if (moves.empty() || env.observe().isTerminated) break;
+            if (ply % 4 == 0 && ply >= 8) addPosition(env);
+            const Move move = moves[randomIndex(rng, moves.size())];
+            const GameState state = env.getState();
+            env.push(state.status.isWhite ? getMoveIndex<true>(move)
+                                          : getMoveIndex<false>(move));
+        }
+    }
+    return corpus;
+}
+
+// keeps the compiler from dropping a result that is never used
+template <typename T>
+inline void keep(const T& value) {
+    asm volatile("" : : "r"(&value) : "memory");
+}
+
+struct BenchResult {
+    std::string name;
+    uint64_t ops;
+    double seconds;
+
+    double nsPerOp() const { return 1e9 * seconds / ops; }
+    double opsPerSec() const { return ops / seconds; }
+};
+
+// calls body(entry) for every corpus entry until minTime has passed, body
+// returns the number of operations it did
+template <typename Body>
+BenchResult runBench(const std::string& name, std::vector<CorpusEntry>& corpus,
+                     double minTime, Body&& body) {
+    // one round to warm up the caches
+    for (CorpusEntry& entry : corpus) body(entry);
+
+    uint64_t ops = 0;
+    const auto start = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed{0.0};
+    while (elapsed.count() < minTime) {
+        for (CorpusEntry& entry : corpus) ops += body(entry);
+        elapsed = std::chrono::steady_clock::now() - start;
+    }
+    return BenchResult{name, ops, elapsed.count()};
+}
+
+// calls f with std::true_type or std::false_type for the player to move in
+// state, so that f can pick the isWhite template
+template <typename F>
+inline void forPlayer(const GameState& state, F&& f) {
+    if (state.status.isWhite)
+        f(std::true_type{});
+    else
+        f(std::false_type{});
+}
+
+std::vector<BenchResult> runBenchmarks(std::vector<CorpusEntry>& corpus,
+                                       const BenchOptions& options) {
+    std::vector<BenchResult> results;
+    const auto bench = [&](const std::string& name, auto&& body) {
+        if (name.find(options.filter) == std::string::npos) return;
+        results.push_back(runBench(name, corpus, options.minTime, body));
+        const BenchResult& result = results.back();
+        std::cout << std::left << std::setw(28) << result.name << std::right
+                  << std::setw(12) << std::fixed << std::setprecision(1)
+                  << result.nsPerOp() << " ns/op" << std::setw(16)
+                  << std::setprecision(0) << result.opsPerSec() << " ops/sec"
+                  << std::endl;
+    };
+
+    bench("getCheckMask", [](CorpusEntry& entry) {
+        forPlayer(entry.state, [&](auto isWhite) {
+            keep(Movegen::getCheckMask<isWhite()>(entry.state));
+        });
+        return 1;
+    });
+    bench("getPinMaskHV", [](CorpusEntry& entry) {
+        forPlayer(entry.state, [&](auto isWhite) {
+            keep(Movegen::getPinMaskHV<isWhite()>(entry.state,
+                                                     entry.checkMask));
+        });
+        return 1;
+    });
+    bench("getPinMaskDG", [](CorpusEntry& entry) {
+        forPlayer(entry.state, [&](auto isWhite) {
+            keep(Movegen::getPinMaskDG<isWhite()>(entry.state,
+                                                     entry.checkMask));
+        });
+        return 1;
+    });
+    bench("getSeenSquares", [](CorpusEntry& entry) {
+        forPlayer(entry.state, [&](auto isWhite) {
+            keep(Movegen::getSeenSquares<isWhite()>(entry.state));
+        });
+        return 1;
+    });
+    bench("getLegalMoves", [](CorpusEntry& entry) {
+        MoveList moves;
+        Movegen::getLegalMoves(entry.state, moves);
+        keep(moves);
+        return 1;
+    });
+    bench("countLegalMoves", [](CorpusEntry& entry) {
+        keep(Movegen::countLegalMoves(entry.state));
+        return 1;
+    });
+    bench("getMoveIndex", [](CorpusEntry& entry) {
+        forPlayer(entry.state, [&](auto isWhite) {
+            for (const Move move : entry.moves) {
+                keep(getMoveIndex<isWhite()>(move));
+            }
+        });
+        return entry.moves.size();
+    });
+    bench("generateLegalActionMask", [](CorpusEntry& entry) {
+        forPlayer(entry.state, [&](auto isWhite) {
+            keep(generateLegalActionMask<isWhite()>(entry.state));
+        });
+        return 1;
+    });
+    bench("generateObservation", [](CorpusEntry& entry) {
+        keep(generateObservation(entry.state));
+        return 1;
+    });
+    bench("writeObservationPlanes", [](CorpusEntry& entry) {
+        std::array<Bitboard, NUM_OBSERVATION_PLANES> planes;
+        writeObservationPlanes(entry.state, planes.data());
+        keep(planes);
+        return 1;
+    });
+    bench("Zobrist::hashBoard", [](CorpusEntry& entry) {
+        forPlayer(entry.state, [&](auto isWhite) {
+            keep(Zobrist::hashBoard<isWhite()>(entry.state));
+        });
+        return 1;
+    });
+    bench("parseFen", [](CorpusEntry& entry) {
+        keep(parseFen(entry.fen));
+        return 1;
+    });
+    // a move has to be taken back to play the next one on the same state, so
+    // unmakeMove is part of the time
+    bench("makeMove+unmakeMove", [](CorpusEntry& entry) {
+        GameState& state = entry.state;
+        forPlayer(state, [&](auto isWhite) {
+            for (const Move move : entry.moves) {
+                const UndoInfo undo = makeMoveWithUndo<isWhite()>(
+                    state, getMoveIndex<isWhite()>(move));
+                keep(state);
+                unmakeMove<isWhite()>(state, undo);
+            }
+        });
+        return entry.moves.size();
+    });
+    bench("ChessGameEnv copy", [](CorpusEntry& entry) {
+        const ChessGameEnv copy(entry.env);
+        keep(copy);
+        return 1;
+    });
+    return results;
+}
+
+void writeJson(const std::string& path, size_t corpusSize,
+               const std::vector<BenchResult>& results) {
+    std::ofstream out(path);
+    if (!out) {
+        throw std::runtime_error("Error: can't write " + path + ".");
+    }
+    out << std::setprecision(10);
+    out << "{\n  \"corpus_size\": " << corpusSize << ",\n";
+    out << "  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& result = results[i];
+        out << "    {\"name\": \"" << result.name
+            << "\", \"ops\": " << result.ops
+            << ", \"seconds\": " << result.seconds
+            << ", \"ns_per_op\": " << result.nsPerOp()
+            << ", \"ops_per_sec\": " << result.opsPerSec() << "}"
+            << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+int main(int argc, char** argv) {
+    try {
+        const BenchOptions options = parseOptions(argc, argv);
+        std::vector<CorpusEntry> corpus = createCorpus();
+        std::cout << "corpus: " << corpus.size() << " positions" << std::endl;
+        const std::vector<BenchResult> results =
+            runBenchmarks(corpus, options);
+        if (!options.jsonPath.empty()) {
+            writeJson(options.jsonPath, corpus.size(), results);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
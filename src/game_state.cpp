@@ -16,24 +16,27 @@ PastGameState::PastGameState(const GameState &state)
       b_bishop(state.b_bishop),
       b_queen(state.b_queen),
       b_king(state.b_king),
-      enpassant_board(state.enpassant_board) {
-    if (state.status.isWhite) {
-        positionHash = Zobrist::hashBoard<true>(state);
-    } else {
-        positionHash = Zobrist::hashBoard<false>(state);
-    }
-}
+      enpassant_board(state.enpassant_board),
+      positionHash(state.positionHash) {}
 
-void GameState::addHistory(const PastGameState &pastState) {
+HistoryUndo GameState::addHistory(const PastGameState &pastState) {
+    HistoryUndo undo;
+    undo.oldest = stateHistory[6];
     for (int i = 6; i > 0; i--) {
         stateHistory[i] = stateHistory[i - 1];
     }
     stateHistory[0] = pastState;
 
-    const uint64_t posHash = pastState.positionHash;
-    // std::cout << "Adding: " << posHash << std::endl;
-    int currentValue = this->positionHashes[posHash];
-    this->positionHashes[posHash] = currentValue + 1;
+    undo.overwrittenKey = positionHashes.push(pastState.positionHash);
+    return undo;
+}
+
+void GameState::removeHistory(const HistoryUndo &undo) {
+    for (int i = 0; i < 6; i++) {
+        stateHistory[i] = stateHistory[i + 1];
+    }
+    stateHistory[6] = undo.oldest;
+    positionHashes.pop(undo.overwrittenKey);
 }
 
 void GameState::setEnpassant(Bitboard enpassantBoard) {
@@ -45,7 +48,7 @@ void GameState::clearEnpassant() {
     enpassant_board = 0ull;
     status.enpassant = false;
 }
-uint64_t GameState::getPositionHash() const {
+uint64_t GameState::computePositionHash() const {
     if (status.isWhite) {
         return Zobrist::hashBoard<true>(*this);
     } else {
@@ -85,6 +88,7 @@ GameState GameStateEmpty() {
     status.enpassant = false;
 
     gameState.status = status;
+    gameState.positionHash = gameState.computePositionHash();
     return gameState;
 }
 
@@ -184,5 +188,6 @@ GameState parseFen(const std::string &fen) {
     std::string fullMoveCountStr = tokens[5];
     state.fullMoveCount = std::stoi(fullMoveCountStr);
 
+    state.positionHash = state.computePositionHash();
     return state;
 }
@@ -1,86 +1,207 @@
+#include <algorithm>
 #include <chrono>
-#include <vector>
-
-#include "game_env.hpp"
-
-std::vector<int> getActionsFromMask(const std::vector<bool>& mask) {
-    std::vector<int> result;
-    const int size = mask.size();
-    for (int i = 0; i < size; ++i) {
-        if (mask[i]) {
-            result.push_back(i);
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "perft.hpp"
+
+// usage: perft [--suite] [--max-depth N] [--fen FEN] [--depth N] [--divide]
+//              [--threads N] [--scaling] [--hash MB]
+//
+// without a depth the positions of getPerftSuite are checked, --max-depth
+// skips the deeper ones. with a depth the fen (the start position by
+// default) is counted at every depth up to it, --divide prints the counts of
+// the root moves at that depth instead. --threads splits the first two
+// plies over a thread pool and --scaling counts the fen at depth (6 if not
+// given) with 1, 2, 4, ... up to that many threads. --hash counts every
+// subtree only once with a PerftTable of that size shared by all threads
+struct PerftOptions {
+    std::string fen =
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+    int depth = 0;
+    int maxDepth = 7;
+    size_t threads = 1;
+    size_t hashMb = 0;
+    bool divide = false;
+    bool suite = false;
+    bool scaling = false;
+};
+
+PerftOptions parseOptions(int argc, char** argv) {
+    PerftOptions options;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        const auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                throw std::runtime_error("Error: " + arg + " needs a value.");
+            }
+            return argv[++i];
+        };
+        if (arg == "--fen") {
+            options.fen = value();
+        } else if (arg == "--depth") {
+            options.depth = std::stoi(value());
+        } else if (arg == "--max-depth") {
+            options.maxDepth = std::stoi(value());
+        } else if (arg == "--divide") {
+            options.divide = true;
+        } else if (arg == "--suite") {
+            options.suite = true;
+        } else if (arg == "--threads") {
+            options.threads = std::max(1, std::stoi(value()));
+        } else if (arg == "--hash") {
+            options.hashMb = std::stoul(value());
+        } else if (arg == "--scaling") {
+            options.scaling = true;
+        } else {
+            throw std::runtime_error("Error: unknown argument " + arg + ".");
         }
     }
-    return result;
+    if (options.depth == 0 && !options.scaling) options.suite = true;
+    return options;
 }
 
-uint64_t perft(int depth, ChessGameEnv& env) {
-    if (depth == 0)
-        return 1;  // Base case: at depth 0, it's just the current position
-
-    uint64_t nodes = 0;
-
-    ChessObservation obs = env.observe();
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
 
-    // Check if game has ended (checkmate, stalemate, etc.)
-    if (obs.isTerminated && !(obs.blackReward || obs.whiteReward)) {
-        return 1;  // This is a terminal node, count it
-    }
+void printResult(int depth, uint64_t nodes, double seconds) {
+    std::cout << "Depth: " << depth << " | Nodes: " << nodes
+              << " | Time: " << seconds << " seconds"
+              << " | NPS: " << static_cast<uint64_t>(nodes / seconds)
+              << std::endl;
+}
 
-    const std::vector<bool> actionMask = obs.actionMask;
-    const std::vector<int> moves = getActionsFromMask(actionMask);
-    for (const auto& move : moves) {
-        ChessGameEnv new_env = env;
-        new_env.step(move);
-        // Recursive call to explore further moves
-        nodes += perft(depth - 1, new_env);
+// without a pool the count runs on this thread, table can be null
+uint64_t countNodes(GameState& state, int depth, ThreadPool* pool,
+                    PerftTable* table) {
+    if (!pool) return perft(state, depth, table);
+    uint64_t nodes = 0;
+    for (const PerftDivide& entry : perftDivide(state, depth, *pool, table)) {
+        nodes += entry.nodes;
     }
     return nodes;
 }
 
-int testAll() {
-    ChessGameEnv env;
-
-    // Incrementally test depths 1 to 5
-    for (int depth = 1; depth <= 5; ++depth) {
-        auto start_time = std::chrono::high_resolution_clock::now();
-
-        uint64_t nodes = perft(depth, env);
-
-        auto end_time = std::chrono::high_resolution_clock::now();
-        std::chrono::duration<double> elapsed_time = end_time - start_time;
+std::unique_ptr<ThreadPool> createPool(size_t threads) {
+    if (threads <= 1) return nullptr;
+    return std::make_unique<ThreadPool>(threads);
+}
 
-        std::cout << "Depth: " << depth << " | Nodes: " << nodes
-                  << " | Time: " << elapsed_time.count() << " seconds"
-                  << std::endl;
+int runSuite(int maxDepth, ThreadPool* pool, PerftTable* table) {
+    int failures = 0;
+    uint64_t totalNodes = 0;
+    double totalSeconds = 0.0;
+    for (const PerftPosition& position : getPerftSuite()) {
+        if (position.depth > maxDepth) continue;
+        GameState state = parseFen(position.fen);
+
+        const auto start = std::chrono::steady_clock::now();
+        const uint64_t nodes = countNodes(state, position.depth, pool, table);
+        const double seconds = secondsSince(start);
+        totalNodes += nodes;
+        totalSeconds += seconds;
+
+        const bool isCorrect = nodes == position.nodes;
+        failures += !isCorrect;
+        std::cout << (isCorrect ? "ok     " : "FAILED ") << position.name
+                  << " | ";
+        printResult(position.depth, nodes, seconds);
+        if (!isCorrect) {
+            std::cout << "  expected " << position.nodes << " for "
+                      << position.fen << std::endl;
+        }
     }
-
-    return 0;
+    std::cout << "Total: " << totalNodes << " nodes | " << totalSeconds
+              << " seconds | NPS: "
+              << static_cast<uint64_t>(totalNodes / totalSeconds) << " | "
+              << failures << " failed" << std::endl;
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
-int testSingle(int depth) {
-    ChessGameEnv env;
-
-    auto start_time = std::chrono::high_resolution_clock::now();
 
-    uint64_t nodes = perft(depth, env);
+int runDivide(GameState& state, int depth, ThreadPool* pool,
+              PerftTable* table) {
+    const auto start = std::chrono::steady_clock::now();
+    const std::vector<PerftDivide> moves =
+        pool ? perftDivide(state, depth, *pool, table)
+             : perftDivide(state, depth, table);
+    const double seconds = secondsSince(start);
 
-    auto end_time = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double> elapsed_time = end_time - start_time;
-
-    std::cout << "Depth: " << depth << " | Nodes: " << nodes
-              << " | Time: " << elapsed_time.count() << " seconds" << std::endl;
+    uint64_t nodes = 0;
+    for (const PerftDivide& entry : moves) {
+        std::cout << moveToUci(entry.move) << ": " << entry.nodes << std::endl;
+        nodes += entry.nodes;
+    }
+    std::cout << "Moves: " << moves.size() << std::endl;
+    printResult(depth, nodes, seconds);
+    return EXIT_SUCCESS;
+}
 
-    return 0;
+int runDepths(GameState& state, int maxDepth, ThreadPool* pool,
+              PerftTable* table) {
+    for (int depth = 1; depth <= maxDepth; depth++) {
+        const auto start = std::chrono::steady_clock::now();
+        const uint64_t nodes = countNodes(state, depth, pool, table);
+        printResult(depth, nodes, secondsSince(start));
+    }
+    return EXIT_SUCCESS;
 }
 
-int runSingle(int depth) {
-    ChessGameEnv env;
-    volatile uint64_t nodes = perft(depth, env);
-    return 0;
+// the speedup of every thread count over a single thread, the efficiency is
+// the speedup divided by the number of threads
+int runScaling(GameState& state, int depth, size_t maxThreads,
+               PerftTable* table) {
+    std::vector<size_t> threadCounts;
+    for (size_t threads = 1; threads < maxThreads; threads *= 2) {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(maxThreads);
+
+    double baseSeconds = 0.0;
+    for (const size_t threads : threadCounts) {
+        const std::unique_ptr<ThreadPool> pool = createPool(threads);
+        // every thread count starts with an empty table
+        if (table) table->clear();
+        const auto start = std::chrono::steady_clock::now();
+        const uint64_t nodes = countNodes(state, depth, pool.get(), table);
+        const double seconds = secondsSince(start);
+        if (threads == 1) baseSeconds = seconds;
+
+        const double speedup = baseSeconds / seconds;
+        std::cout << "Threads: " << threads << " | ";
+        printResult(depth, nodes, seconds);
+        std::cout << "  speedup " << speedup << " | efficiency "
+                  << 100.0 * speedup / threads << "%" << std::endl;
+    }
+    return EXIT_SUCCESS;
 }
 
-int main() {
-    // runSingle(5);
-    // testSingle(7);
-    testAll();
+int main(int argc, char** argv) {
+    try {
+        const PerftOptions options = parseOptions(argc, argv);
+        GameState state = parseFen(options.fen);
+        const std::unique_ptr<PerftTable> table =
+            options.hashMb > 0 ? std::make_unique<PerftTable>(options.hashMb)
+                               : nullptr;
+        if (options.scaling) {
+            return runScaling(state, options.depth ? options.depth : 6,
+                              options.threads, table.get());
+        }
+
+        const std::unique_ptr<ThreadPool> pool = createPool(options.threads);
+        if (options.suite) {
+            return runSuite(options.maxDepth, pool.get(), table.get());
+        }
+        if (options.divide) {
+            return runDivide(state, options.depth, pool.get(), table.get());
+        }
+        return runDepths(state, options.depth, pool.get(), table.get());
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
 }
@@ -1,10 +1,25 @@
 #define CATCH_CONFIG_MAIN
 #include <catch2/catch.hpp>
 
+#include <atomic>
+#include <numeric>
+#include <chrono>
+#include <thread>
+
 #include "types.hpp"
 #include "game_state.hpp"
 #include "moves.hpp"
 #include "move_gen.hpp"
+#include "game_state_utils.hpp"
+#include "arena.hpp"
+#include "batched_env.hpp"
+#include "compact_state.hpp"
+#include "eval_cache.hpp"
+#include "game_env.hpp"
+#include "mcts.hpp"
+#include "parallel_mcts.hpp"
+#include "perft.hpp"
+#include "playout.hpp"
 
 
 TEST_CASE("GameStatus: to and from pattern alternating") {
@@ -186,3 +201,965 @@ GENERATE_PINMASK_DG_TEST("h4", "g5", 0ull);
 GENERATE_PINMASK_DG_TEST("a5", "d2", 0x102040800);
 GENERATE_PINMASK_DG_TEST("a6", "d2", 0ull);
 GENERATE_PINMASK_DG_TEST("e2", "e3", 0ull);
+
+
+TEST_CASE("MoveList: push_back, size and clear") {
+    MoveList moves;
+    REQUIRE(moves.empty());
+    moves.push_back(Movegen::create_move(12ull, 28ull, 0b0001));
+    moves.push_back(Movegen::create_move(6ull, 21ull, 0b0000));
+    REQUIRE(moves.size() == 2);
+    REQUIRE(moves[1] == Movegen::create_move(6ull, 21ull, 0b0000));
+    moves.clear();
+    REQUIRE(moves.size() == 0);
+}
+
+TEST_CASE("MoveList: matches the compatibility wrapper") {
+    GameState state;
+    MoveList moves;
+    Movegen::getLegalMoves(state, moves);
+    const Moves expected = Movegen::getLegalMoves(state);
+    REQUIRE(moves.size() == 20);
+    REQUIRE(Moves(moves.begin(), moves.end()) == expected);
+}
+
+TEST_CASE("MoveGenContext: matches the individual masks") {
+    const GameState state = parseFen(
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+    const Movegen::MoveGenContext ctx =
+        Movegen::createMoveGenContext<true>(state);
+    REQUIRE(ctx.occupied == (ctx.enemies | ctx.friendlies));
+    REQUIRE(ctx.checkMask == Movegen::getCheckMask<true>(state));
+    REQUIRE(ctx.pinMaskHV == Movegen::getPinMaskHV<true>(state));
+    REQUIRE(ctx.pinMaskDG == Movegen::getPinMaskDG<true>(state));
+    REQUIRE(ctx.enemySeenSquares == Movegen::getSeenSquares<false>(state));
+}
+
+TEST_CASE("Lookup: packed slider tables") {
+    REQUIRE(Lookup::bishopAttackTableSize == 5248);
+    REQUIRE(Lookup::rookAttackTableSize == 102400);
+    // rook on a1 blocked on a3 and c1
+    const Bitboard occupied = (1ull << 16) | (1ull << 2);
+    REQUIRE(Lookup::getRookAttacks(0ull, occupied) ==
+            ((1ull << 8) | (1ull << 16) | (1ull << 1) | (1ull << 2)));
+    // the x-ray removes the first blockers and stops at the next ones
+    REQUIRE(Lookup::getXrayRookAttacks(0ull, occupied | (1ull << 32)) ==
+            ((1ull << 8) | (1ull << 16) | (1ull << 24) | (1ull << 32) |
+             0xfeull));
+    REQUIRE(Lookup::getBishopAttacks(0ull, 0ull) == 0x8040201008040200ull);
+}
+
+TEST_CASE("Movegen: countLegalMoves matches the generated moves") {
+    const std::string fen = GENERATE(
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+        "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+        "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+        "rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3");
+    const GameState state = parseFen(fen);
+    MoveList moves;
+    Movegen::getLegalMoves(state, moves);
+    REQUIRE(Movegen::countLegalMoves(state) == moves.size());
+}
+
+TEST_CASE("Zobrist: incremental key matches a full recomputation") {
+    // castles, a capture, a double push with enpassant and a promotion
+    GameState state = parseFen(
+        "r3k2r/pPppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/P1PBBPPP/R3K2R w KQkq - 0 1");
+    const std::vector<std::pair<Move, bool>> moves = {
+        {Movegen::create_move(4ull, 6ull, 0b0010), true},
+        {Movegen::create_move(60ull, 62ull, 0b0010), false},
+        {Movegen::create_move(8ull, 24ull, 0b0001), true},
+        {Movegen::create_move(25ull, 16ull, 0b0101), false},
+        {Movegen::create_move(49ull, 56ull, 0b1100), true},
+    };
+    for (const auto &[move, isWhite] : moves) {
+        if (isWhite)
+            makeMove<true>(state, getMoveIndex<true>(move));
+        else
+            makeMove<false>(state, getMoveIndex<false>(move));
+        REQUIRE(state.positionHash == state.computePositionHash());
+    }
+}
+
+TEST_CASE("Zobrist: transpositions have the same key") {
+    GameState first;
+    GameState second;
+    const auto play = [](GameState &state, std::vector<Move> moves) {
+        for (const Move move : moves) {
+            if (state.status.isWhite)
+                makeMove<true>(state, getMoveIndex<true>(move));
+            else
+                makeMove<false>(state, getMoveIndex<false>(move));
+        }
+    };
+    const Move nf3 = Movegen::create_move(6ull, 21ull, 0);
+    const Move nf6 = Movegen::create_move(62ull, 45ull, 0);
+    const Move nc3 = Movegen::create_move(1ull, 18ull, 0);
+    const Move nc6 = Movegen::create_move(57ull, 42ull, 0);
+    play(first, {nf3, nf6, nc3, nc6});
+    play(second, {nc3, nc6, nf3, nf6});
+    REQUIRE(first.positionHash == second.positionHash);
+    REQUIRE(first.positionHash != GameState().positionHash);
+}
+
+TEST_CASE("RepetitionHistory: only positions with the same player count") {
+    RepetitionHistory history;
+    history.push(1ull);
+    history.push(2ull);
+    history.push(1ull);
+    history.push(2ull);
+    // the next position has the same player to move as the keys 1
+    REQUIRE(history.count(1ull, 0) == 2);
+    REQUIRE(history.count(2ull, 0) == 0);
+    REQUIRE(history.count(2ull, 1) == 2);
+    history.clear();
+    REQUIRE(history.count(1ull, 0) == 0);
+}
+
+TEST_CASE("RepetitionHistory: overwrites the oldest keys when full") {
+    RepetitionHistory history;
+    for (uint64_t i = 0; i < RepetitionHistory::capacity + 2; i++) {
+        history.push(i);
+    }
+    REQUIRE(history.size() == RepetitionHistory::capacity);
+    REQUIRE(history.count(0ull, 0) == 0);
+    REQUIRE(history.count(RepetitionHistory::capacity, 0) == 1);
+}
+
+TEST_CASE("GameState: threefold repetition by moving knights back and forth") {
+    GameState state;
+    const Move moves[4] = {
+        Movegen::create_move(6ull, 21ull, 0),
+        Movegen::create_move(62ull, 45ull, 0),
+        Movegen::create_move(21ull, 6ull, 0),
+        Movegen::create_move(45ull, 62ull, 0),
+    };
+    for (int ply = 0; ply < 8; ply++) {
+        REQUIRE_FALSE(isDrawBy3FoldRepetition<true>(state));
+        state.addHistory(PastGameState(state));
+        if (state.status.isWhite)
+            makeMove<true>(state, getMoveIndex<true>(moves[ply % 4]));
+        else
+            makeMove<false>(state, getMoveIndex<false>(moves[ply % 4]));
+    }
+    REQUIRE(isDrawBy3FoldRepetition<true>(state));
+}
+
+TEST_CASE("CompactGameState: observations match the full state") {
+    // a game that castles, takes enpassant and repeats the position
+    const std::vector<Move> moves = {
+        Movegen::create_move(12ull, 28ull, 0b0001),  // e4
+        Movegen::create_move(57ull, 42ull, 0),       // Nc6
+        Movegen::create_move(28ull, 36ull, 0),       // e5
+        Movegen::create_move(51ull, 35ull, 0b0001),  // d5
+        Movegen::create_move(36ull, 43ull, 0b0101),  // exd6
+        Movegen::create_move(62ull, 45ull, 0),       // Nf6
+        Movegen::create_move(6ull, 21ull, 0),        // Nf3
+        Movegen::create_move(45ull, 62ull, 0),       // Ng8
+        Movegen::create_move(21ull, 6ull, 0),        // Ng1
+        Movegen::create_move(62ull, 45ull, 0),       // Nf6
+        Movegen::create_move(6ull, 21ull, 0),        // Nf3
+        Movegen::create_move(45ull, 62ull, 0),       // Ng8
+    };
+    GameState state;
+    HistoryStore store;
+    CompactGameState compact = compressGameState(state, store);
+    for (const Move move : moves) {
+        const bool isWhite = state.status.isWhite;
+        const Action action =
+            isWhite ? getMoveIndex<true>(move) : getMoveIndex<false>(move);
+        state.addHistory(PastGameState(state));
+        if (isWhite)
+            makeMove<true>(state, action);
+        else
+            makeMove<false>(state, action);
+        makeMove(compact, store, action);
+
+        const GameState expanded = expandGameState(compact, store);
+        const ChessObservation expected = state.status.isWhite
+                                              ? observeTemplate<true>(state)
+                                              : observeTemplate<false>(state);
+        const ChessObservation actual =
+            expanded.status.isWhite ? observeTemplate<true>(expanded)
+                                    : observeTemplate<false>(expanded);
+        REQUIRE(actual.observation == expected.observation);
+        REQUIRE(actual.actionMask == expected.actionMask);
+        REQUIRE(actual.isTerminated == expected.isTerminated);
+    }
+}
+
+TEST_CASE("CompactGameState: repetition keys older than its ring") {
+    const auto sameKeys = [](const RepetitionHistory &a,
+                             const RepetitionHistory &b) {
+        if (a.size() != b.size()) return false;
+        for (uint32_t distance = 1; distance <= a.size(); distance++) {
+            if (a.get(distance) != b.get(distance)) return false;
+        }
+        return true;
+    };
+
+    uint32_t maxKeys = 0;
+    for (uint64_t seed = 0; seed < 8; seed++) {
+        PlayoutRng rng(seed);
+        GameState state;
+        HistoryStore store;
+        CompactGameState compact = compressGameState(state, store);
+        for (int ply = 0; ply < 300; ply++) {
+            MoveList moves;
+            Movegen::getLegalMoves(state, moves);
+            if (moves.size() == 0 || isDrawBy50Moves(state)) break;
+            const Move move = moves[randomIndex(rng, moves.size())];
+            const bool isWhite = state.status.isWhite;
+            const Action action =
+                isWhite ? getMoveIndex<true>(move) : getMoveIndex<false>(move);
+            state.addHistory(PastGameState(state));
+            if (isWhite)
+                makeMove<true>(state, action);
+            else
+                makeMove<false>(state, action);
+            makeMove(compact, store, action);
+            maxKeys = std::max(maxKeys, state.positionHashes.size());
+
+            REQUIRE(sameKeys(expandGameState(compact, store).positionHashes,
+                             state.positionHashes));
+            // a state compressed in the middle of a game keeps them too
+            HistoryStore freshStore;
+            const CompactGameState fresh = compressGameState(state, freshStore);
+            REQUIRE(sameKeys(expandGameState(fresh, freshStore).positionHashes,
+                             state.positionHashes));
+        }
+    }
+    REQUIRE(maxKeys > 16);
+}
+
+TEST_CASE("CompactGameState: truncating the store") {
+    HistoryStore store;
+    CompactGameState compact = compressGameState(GameState(), store);
+    const uint32_t gameStart = store.size();
+    makeMove(compact, store, getMoveIndex<true>(Movegen::create_move(
+                                 6ull, 21ull, 0)));  // Nf3
+    REQUIRE(store.size() == gameStart + 1);
+    store.truncate(gameStart);
+    REQUIRE(store.size() == gameStart);
+    // a larger size keeps everything
+    store.truncate(gameStart + 10);
+    REQUIRE(store.size() == gameStart);
+}
+
+namespace {
+
+bool sameState(const GameState &a, const GameState &b) {
+    return a.w_pawn == b.w_pawn && a.w_knight == b.w_knight &&
+           a.w_bishop == b.w_bishop && a.w_rook == b.w_rook &&
+           a.w_queen == b.w_queen && a.w_king == b.w_king &&
+           a.b_pawn == b.b_pawn && a.b_knight == b.b_knight &&
+           a.b_bishop == b.b_bishop && a.b_rook == b.b_rook &&
+           a.b_queen == b.b_queen && a.b_king == b.b_king &&
+           a.enpassant_board == b.enpassant_board &&
+           a.status.getStatusPattern() == b.status.getStatusPattern() &&
+           a.halfMoveClock == b.halfMoveClock &&
+           a.fullMoveCount == b.fullMoveCount &&
+           a.positionHash == b.positionHash &&
+           a.positionHashes.begin == b.positionHashes.begin &&
+           a.positionHashes.end == b.positionHashes.end;
+}
+
+template <bool isWhite>
+void checkUnmakeMove(const GameState &state, int depth) {
+    if (depth == 0) return;
+    MoveList moves;
+    Movegen::getLegalMoves(state, moves);
+    for (const Move move : moves) {
+        GameState copy = state;
+        const UndoInfo undo =
+            makeMoveWithUndo<isWhite>(copy, getMoveIndex<isWhite>(move));
+        checkUnmakeMove<!isWhite>(copy, depth - 1);
+        unmakeMove<isWhite>(copy, undo);
+        REQUIRE(sameState(copy, state));
+    }
+}
+
+}  // namespace
+
+TEST_CASE("unmakeMove: restores the state exactly") {
+    // castles, enpassant and promotions with and without captures
+    const std::string fen = GENERATE(
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+        "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+        "r2q1rk1/pP1p2pp/Q4n2/bbp1p3/Np6/1B3NBn/pPPP1PPP/R3K2R b KQ - 0 1");
+    const GameState state = parseFen(fen);
+    if (state.status.isWhite)
+        checkUnmakeMove<true>(state, 3);
+    else
+        checkUnmakeMove<false>(state, 3);
+}
+
+TEST_CASE("Perft: the small positions of the suite") {
+    for (const PerftPosition &position : getPerftSuite()) {
+        if (position.nodes > 5000000) continue;
+        GameState state = parseFen(position.fen);
+        const GameState copy = state;
+        INFO(position.name);
+        REQUIRE(perft(state, position.depth) == position.nodes);
+        REQUIRE(sameState(state, copy));
+    }
+}
+
+TEST_CASE("Perft: divide adds up to the total") {
+    GameState state = parseFen(
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+    const std::vector<PerftDivide> moves = perftDivide(state, 3);
+    REQUIRE(moves.size() == 48);
+    uint64_t nodes = 0;
+    for (const PerftDivide &entry : moves) nodes += entry.nodes;
+    REQUIRE(nodes == 97862);
+    const auto castle = std::find_if(
+        moves.begin(), moves.end(),
+        [](const PerftDivide &entry) { return moveToUci(entry.move) == "e1g1"; });
+    REQUIRE(castle != moves.end());
+    REQUIRE(castle->nodes == 2059);
+}
+
+TEST_CASE("Perft: a table doesn't change the counts") {
+    PerftTable table(1);
+    ThreadPool pool(4);
+    for (const PerftPosition &position : getPerftSuite()) {
+        if (position.nodes > 5000000) continue;
+        GameState state = parseFen(position.fen);
+        INFO(position.name);
+        REQUIRE(perft(state, position.depth, &table) == position.nodes);
+        // the second time most subtrees come from the table
+        uint64_t nodes = 0;
+        for (const PerftDivide &entry :
+             perftDivide(state, position.depth, pool, &table)) {
+            nodes += entry.nodes;
+        }
+        REQUIRE(nodes == position.nodes);
+    }
+}
+
+TEST_CASE("Perft: the threaded divide matches the serial one") {
+    ThreadPool pool(4);
+    for (const char *fen :
+         {"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+          "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1"}) {
+        GameState state = parseFen(fen);
+        for (int depth = 1; depth <= 4; depth++) {
+            const std::vector<PerftDivide> serial = perftDivide(state, depth);
+            const std::vector<PerftDivide> threaded =
+                perftDivide(state, depth, pool);
+            REQUIRE(serial.size() == threaded.size());
+            for (size_t i = 0; i < serial.size(); i++) {
+                REQUIRE(serial[i].move == threaded[i].move);
+                REQUIRE(serial[i].nodes == threaded[i].nodes);
+            }
+        }
+    }
+}
+
+TEST_CASE("ChessGameEnv: pop undoes push") {
+    ChessGameEnv env;
+    const ChessObservation before = env.observe();
+    // e4 e5 Nf3 Nc6
+    env.push(getMoveIndex<true>(Movegen::create_move(12ull, 28ull, 0b0001)));
+    env.push(getMoveIndex<false>(Movegen::create_move(52ull, 36ull, 0b0001)));
+    env.push(getMoveIndex<true>(Movegen::create_move(6ull, 21ull, 0)));
+    env.push(getMoveIndex<false>(Movegen::create_move(57ull, 42ull, 0)));
+    for (int i = 0; i < 4; i++) env.pop();
+    const ChessObservation after = env.observe();
+    REQUIRE(after.observation == before.observation);
+    REQUIRE(after.actionMask == before.actionMask);
+    REQUIRE_THROWS(env.pop());
+}
+
+TEST_CASE("ChessGameEnv: copies can't pop the moves of the original") {
+    ChessGameEnv env;
+    env.push(getMoveIndex<true>(Movegen::create_move(12ull, 28ull, 0b0001)));
+    const ChessObservation pushed = env.observe();
+
+    ChessGameEnv constructed(env);
+    ChessGameEnv assigned;
+    assigned.push(getMoveIndex<true>(Movegen::create_move(6ull, 21ull, 0)));
+    assigned = env;
+    for (ChessGameEnv* copy : {&constructed, &assigned}) {
+        REQUIRE(copy->observe().observation == pushed.observation);
+        REQUIRE_THROWS(copy->pop());
+    }
+
+    ChessGameEnv moved(std::move(env));
+    moved.pop();
+    REQUIRE(moved.observe().observation ==
+            ChessGameEnv().observe().observation);
+}
+
+TEST_CASE("ChessGameEnv: observeInto matches observe") {
+    ChessGameEnv env("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+    // stale values in the buffers have to be overwritten
+    std::vector<uint8_t> obs(OBSERVATION_SPACE_SIZE, 1);
+    std::vector<uint8_t> mask(ACTION_SPACE_SIZE, 1);
+    // O-O, Nc4 and queen and knight moves back to repeat a position
+    const std::vector<Action> actions = {
+        getMoveIndex<true>(Movegen::create_move(4ull, 6ull, 0b0010)),
+        getMoveIndex<false>(Movegen::create_move(41ull, 26ull, 0)),
+        getMoveIndex<true>(Movegen::create_move(21ull, 22ull, 0)),
+        getMoveIndex<false>(Movegen::create_move(45ull, 55ull, 0)),
+        getMoveIndex<true>(Movegen::create_move(22ull, 21ull, 0)),
+        getMoveIndex<false>(Movegen::create_move(55ull, 45ull, 0)),
+    };
+    for (const Action action : actions) {
+        const ChessObservation expected = env.observe();
+        const TerminationInfo term = env.observeInto(obs.data(), mask.data());
+        REQUIRE(std::equal(obs.begin(), obs.end(),
+                           expected.observation.begin()));
+        REQUIRE(std::equal(mask.begin(), mask.end(),
+                           expected.actionMask.begin()));
+        REQUIRE(term.isTerminated == expected.isTerminated);
+        REQUIRE(term.whiteReward == expected.whiteReward);
+        env.step(action);
+    }
+}
+
+TEST_CASE("ChessGameEnv: observation planes match the flat observation") {
+    ChessGameEnv env("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+    std::array<Bitboard, NUM_OBSERVATION_PLANES> planes;
+    std::vector<uint8_t> mask(ACTION_SPACE_SIZE);
+    // O-O and d5 so that the next observation has an enpassant square
+    const std::vector<Action> actions = {
+        getMoveIndex<true>(Movegen::create_move(4ull, 6ull, 0b0010)),
+        getMoveIndex<false>(Movegen::create_move(51ull, 35ull, 0b0001)),
+    };
+    for (int i = 0; i <= static_cast<int>(actions.size()); i++) {
+        const ChessObservation expected = env.observe();
+        const TerminationInfo term =
+            env.observePlanesInto(planes.data(), mask.data());
+        for (int plane = 0; plane < NUM_OBSERVATION_PLANES; plane++) {
+            for (int square = 0; square < PLANE_SIZE; square++) {
+                REQUIRE(((planes[plane] >> square) & 1) ==
+                        expected.observation[plane * PLANE_SIZE + square]);
+            }
+        }
+        // constant planes are either empty or full
+        REQUIRE((planes[4] == 0ull || planes[4] == ~0ull));
+        REQUIRE(std::equal(mask.begin(), mask.end(),
+                           expected.actionMask.begin()));
+        REQUIRE(term.isTerminated == expected.isTerminated);
+        if (i < static_cast<int>(actions.size())) env.step(actions[i]);
+    }
+}
+
+TEST_CASE("BatchedChessEnv: matches stepping the games one by one") {
+    constexpr size_t numEnvs = 3;
+    BatchedChessEnv batch(numEnvs);
+    std::vector<ChessGameEnv> envs(numEnvs);
+    std::vector<uint8_t> obs(numEnvs * OBSERVATION_SPACE_SIZE);
+    std::vector<uint8_t> mask(numEnvs * ACTION_SPACE_SIZE);
+    std::vector<int32_t> rewards(numEnvs * 2);
+    std::vector<uint8_t> done(numEnvs);
+
+    // every game plays its own legal move with the lowest action
+    for (int ply = 0; ply < 6; ply++) {
+        batch.observeInto(obs.data(), mask.data(), rewards.data(),
+                          done.data());
+        std::vector<Action> actions(numEnvs);
+        for (size_t i = 0; i < numEnvs; i++) {
+            const ChessObservation expected = envs[i].observe();
+            REQUIRE(std::equal(expected.observation.begin(),
+                               expected.observation.end(),
+                               obs.begin() + i * OBSERVATION_SPACE_SIZE));
+            REQUIRE(std::equal(expected.actionMask.begin(),
+                               expected.actionMask.end(),
+                               mask.begin() + i * ACTION_SPACE_SIZE));
+            REQUIRE(rewards[2 * i] == expected.whiteReward);
+            REQUIRE(rewards[2 * i + 1] == expected.blackReward);
+            REQUIRE(done[i] == expected.isTerminated);
+
+            std::vector<Action> legal;
+            for (Action a = 0; a < ACTION_SPACE_SIZE; a++) {
+                if (expected.actionMask[a]) legal.push_back(a);
+            }
+            actions[i] = legal[(i * 7) % legal.size()];
+            envs[i].step(actions[i]);
+        }
+        batch.step(actions.data());
+    }
+
+    const std::vector<Action> outOfRange(numEnvs, ACTION_SPACE_SIZE);
+    REQUIRE_THROWS(batch.step(outOfRange.data()));
+    REQUIRE_THROWS(batch.reset(numEnvs));
+
+    batch.reset(1);
+    const ChessObservation fresh = ChessGameEnv().observe();
+    std::vector<Bitboard> planes(numEnvs * NUM_OBSERVATION_PLANES);
+    batch.observePlanesInto(planes.data(), mask.data(), rewards.data(),
+                            done.data());
+    std::array<Bitboard, NUM_OBSERVATION_PLANES> expectedPlanes;
+    ChessGameEnv().observePlanes(expectedPlanes.data());
+    REQUIRE(std::equal(expectedPlanes.begin(), expectedPlanes.end(),
+                       planes.begin() + NUM_OBSERVATION_PLANES));
+    REQUIRE(std::equal(fresh.actionMask.begin(), fresh.actionMask.end(),
+                       mask.begin() + ACTION_SPACE_SIZE));
+}
+
+TEST_CASE("ThreadPool: runs every index exactly once") {
+    ThreadPool pool(4);
+    // uneven work so that the workers have to steal
+    std::vector<std::atomic<int>> calls(1000);
+    pool.parallelFor(calls.size(), [&](size_t i) {
+        if (i < 100) {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+        calls[i]++;
+    });
+    REQUIRE(std::all_of(calls.begin(), calls.end(),
+                        [](const std::atomic<int> &c) { return c == 1; }));
+
+    REQUIRE_THROWS(pool.parallelFor(10, [](size_t i) {
+        if (i == 7) throw std::runtime_error("Error: test");
+    }));
+    // the pool still works after an exception
+    std::atomic<size_t> sum = 0;
+    pool.parallelFor(10, [&](size_t i) { sum += i; });
+    REQUIRE(sum == 45);
+}
+
+TEST_CASE("BatchedChessEnv: a bad action doesn't step any game") {
+    BatchedChessEnv batch(3, 2);
+    const ChessObservation start = ChessGameEnv().observe();
+    const Action e4 =
+        getMoveIndex<true>(Movegen::create_move(12ull, 28ull, 0b0001));
+    // e2e5 is in range but not legal
+    const Action e5 = getMoveIndex<true>(Movegen::create_move(12ull, 36ull, 0));
+    const std::vector<Action> illegal = {e4, e5, e4};
+    REQUIRE_THROWS(batch.step(illegal.data()));
+    const std::vector<Action> outOfRange = {e4, e4, ACTION_SPACE_SIZE};
+    REQUIRE_THROWS(batch.step(outOfRange.data()));
+    for (size_t i = 0; i < batch.size(); i++) {
+        REQUIRE(batch[i].observe().observation == start.observation);
+    }
+
+    const std::vector<Action> legal = {e4, e4, e4};
+    batch.step(legal.data());
+    REQUIRE(batch[0].observe().observation != start.observation);
+}
+
+TEST_CASE("BatchedChessEnv: threads give the same result") {
+    constexpr size_t numEnvs = 37;
+    BatchedChessEnv serial(numEnvs);
+    BatchedChessEnv threaded(numEnvs, 4);
+    std::vector<uint8_t> obs(numEnvs * OBSERVATION_SPACE_SIZE);
+    std::vector<uint8_t> mask(numEnvs * ACTION_SPACE_SIZE);
+    std::vector<uint8_t> threadedObs(obs.size());
+    std::vector<uint8_t> threadedMask(mask.size());
+    std::vector<int32_t> rewards(numEnvs * 2);
+    std::vector<uint8_t> done(numEnvs);
+
+    for (int ply = 0; ply < 8; ply++) {
+        serial.observeInto(obs.data(), mask.data(), rewards.data(),
+                           done.data());
+        threaded.observeInto(threadedObs.data(), threadedMask.data(),
+                             rewards.data(), done.data());
+        REQUIRE(obs == threadedObs);
+        REQUIRE(mask == threadedMask);
+
+        std::vector<Action> actions(numEnvs);
+        for (size_t i = 0; i < numEnvs; i++) {
+            const uint8_t *row = mask.data() + i * ACTION_SPACE_SIZE;
+            std::vector<Action> legal;
+            for (Action a = 0; a < ACTION_SPACE_SIZE; a++) {
+                if (row[a]) legal.push_back(a);
+            }
+            actions[i] = legal[(i * 13 + ply) % legal.size()];
+        }
+        serial.step(actions.data());
+        threaded.step(actions.data());
+    }
+}
+
+TEST_CASE("BatchedChessEnv: random self play is deterministic") {
+    constexpr size_t numEnvs = 8;
+    BatchedChessEnv serial(numEnvs);
+    BatchedChessEnv threaded(numEnvs, 4);
+    // enough plies that every game finishes at least once
+    const size_t finished = serial.playRandomSteps(7, 2 * 2 * MAX_GAME_LENGTH);
+    REQUIRE(finished >= numEnvs);
+    REQUIRE(threaded.playRandomSteps(7, 2 * 2 * MAX_GAME_LENGTH) == finished);
+    for (size_t i = 0; i < numEnvs; i++) {
+        REQUIRE(sameState(serial[i].getState(), threaded[i].getState()));
+    }
+}
+
+TEST_CASE("playout: replaying the actions gives the same result") {
+    const uint64_t seed = GENERATE(range(0, 20));
+    PlayoutRng rng(seed);
+    std::vector<Action> actions;
+    const PlayoutResult result = playout(GameState(), rng, 1000, &actions);
+    REQUIRE(result.plies == actions.size());
+
+    ChessGameEnv env;
+    for (const Action action : actions) {
+        REQUIRE_FALSE(env.observe().isTerminated);
+        REQUIRE(env.observe().actionMask[action]);
+        env.step(action);
+    }
+    const ChessObservation obs = env.observe();
+    REQUIRE(obs.isTerminated == result.isTerminated);
+    REQUIRE(obs.whiteReward == result.whiteReward);
+    REQUIRE(obs.blackReward == result.blackReward);
+}
+
+TEST_CASE("playoutBatch: results don't depend on the thread count") {
+    constexpr size_t numGames = 64;
+    std::vector<PlayoutResult> serial(numGames);
+    std::vector<PlayoutResult> threaded(numGames);
+    std::vector<std::vector<Action>> serialActions;
+    std::vector<std::vector<Action>> threadedActions;
+    ThreadPool pool(4);
+    playoutBatch(GameState(), 7, numGames, 60, serial.data(), &serialActions);
+    playoutBatch(GameState(), 7, numGames, 60, threaded.data(),
+                 &threadedActions, &pool);
+    REQUIRE(serialActions == threadedActions);
+    for (size_t i = 0; i < numGames; i++) {
+        REQUIRE(serial[i].plies == threaded[i].plies);
+        REQUIRE(serial[i].plies <= 60);
+        REQUIRE(serial[i].whiteReward == threaded[i].whiteReward);
+    }
+}
+
+namespace {
+
+// every legal action gets the same prior and every position is a draw
+void uniformEvaluator(size_t batchSize, const uint8_t *, const uint8_t *masks,
+                      float *priors, float *values) {
+    for (size_t i = 0; i < batchSize * ACTION_SPACE_SIZE; i++) {
+        priors[i] = masks[i];
+    }
+    std::fill_n(values, batchSize, 0.0f);
+}
+
+}  // namespace
+
+TEST_CASE("BatchedMcts: finds the mate in one") {
+    MctsConfig config;
+    config.numSimulations = 400;
+    config.dirichletEpsilon = 0.0f;
+    BatchedMcts mcts(2, config, 1);
+    // Ra8# for white and Ra1# for black
+    mcts.reset(0, parseFen("6k1/5ppp/8/8/8/8/8/R5K1 w - - 0 1"));
+    mcts.reset(1, parseFen("r5k1/8/8/8/8/8/5PPP/6K1 b - - 0 1"));
+
+    size_t batches = 0;
+    mcts.search([&](size_t batchSize, const uint8_t *obs, const uint8_t *masks,
+                    float *priors, float *values) {
+        batches++;
+        uniformEvaluator(batchSize, obs, masks, priors, values);
+    });
+
+    std::vector<float> counts(ACTION_SPACE_SIZE);
+    mcts.getVisitCounts(0, counts.data());
+    const Action whiteMate =
+        getMoveIndex<true>(Movegen::create_move(0ull, 56ull, 0));
+    REQUIRE(std::max_element(counts.begin(), counts.end()) - counts.begin() ==
+            static_cast<int64_t>(whiteMate));
+    // the root itself takes one of the simulations
+    REQUIRE(std::accumulate(counts.begin(), counts.end(), 0.0f) ==
+            config.numSimulations - 1);
+    REQUIRE(mcts.getRootValue(0) > 0.5f);
+
+    mcts.getVisitCounts(1, counts.data());
+    const Action blackMate =
+        getMoveIndex<false>(Movegen::create_move(56ull, 0ull, 0));
+    REQUIRE(std::max_element(counts.begin(), counts.end()) - counts.begin() ==
+            static_cast<int64_t>(blackMate));
+    // both games share the evaluator calls
+    REQUIRE(batches < config.numSimulations / 2);
+}
+
+TEST_CASE("BatchedMcts: advance keeps the subtree") {
+    MctsConfig config;
+    config.numSimulations = 100;
+    BatchedMcts mcts(1, config, 3);
+    mcts.search(uniformEvaluator);
+
+    std::vector<float> counts(ACTION_SPACE_SIZE);
+    mcts.getVisitCounts(0, counts.data());
+    const Action action =
+        std::max_element(counts.begin(), counts.end()) - counts.begin();
+    const float childVisits = counts[action];
+    mcts.advance(0, action);
+    mcts.getVisitCounts(0, counts.data());
+    REQUIRE(std::accumulate(counts.begin(), counts.end(), 0.0f) ==
+            childVisits - 1);
+
+    REQUIRE_THROWS(mcts.advance(0, ACTION_SPACE_SIZE));
+    REQUIRE_THROWS(mcts.reset(1, GameState()));
+}
+
+TEST_CASE("BatchedMcts: transposition keys") {
+    const auto play = [](GameState &state, std::vector<Move> moves) {
+        for (const Move move : moves) {
+            applyAction(state, state.status.isWhite
+                                   ? getMoveIndex<true>(move)
+                                   : getMoveIndex<false>(move));
+        }
+    };
+    const Move nf3 = Movegen::create_move(6ull, 21ull, 0);
+    const Move nf6 = Movegen::create_move(62ull, 45ull, 0);
+    const Move nc3 = Movegen::create_move(1ull, 18ull, 0);
+    const Move nc6 = Movegen::create_move(57ull, 42ull, 0);
+    const Move e4 = Movegen::create_move(12ull, 28ull, 0b0001);
+
+    // the last move is a pawn move, so the positions on the way don't matter
+    GameState first;
+    GameState second;
+    play(first, {nf3, nf6, nc3, nc6, e4});
+    play(second, {nc3, nc6, nf3, nf6, e4});
+    REQUIRE(getTranspositionKey(first) == getTranspositionKey(second));
+
+    // the same position, but the positions on the way can still repeat
+    GameState third;
+    GameState fourth;
+    play(third, {nf3, nf6, nc3, nc6});
+    play(fourth, {nc3, nc6, nf3, nf6});
+    REQUIRE(third.positionHash == fourth.positionHash);
+    REQUIRE(getTranspositionKey(third) != getTranspositionKey(fourth));
+}
+
+TEST_CASE("BatchedMcts: transpositions share evaluations") {
+    MctsConfig config;
+    config.numSimulations = 3000;
+    config.dirichletEpsilon = 0.0f;
+    size_t evaluated = 0;
+    const MctsEvaluator evaluate = [&](size_t batchSize, const uint8_t *obs,
+                                       const uint8_t *masks, float *priors,
+                                       float *values) {
+        evaluated += batchSize;
+        uniformEvaluator(batchSize, obs, masks, priors, values);
+    };
+
+    BatchedMcts tree(1, config, 4);
+    tree.search(evaluate);
+    REQUIRE(evaluated == config.numSimulations);
+    REQUIRE(tree.getTableSize(0) == 0);
+
+    config.useTranspositions = true;
+    BatchedMcts graph(1, config, 4);
+    evaluated = 0;
+    graph.search(evaluate);
+    REQUIRE(evaluated < config.numSimulations);
+    // every position in the graph was evaluated once
+    REQUIRE(graph.getTableSize(0) == evaluated);
+
+    std::vector<float> counts(ACTION_SPACE_SIZE);
+    graph.getVisitCounts(0, counts.data());
+    REQUIRE(std::accumulate(counts.begin(), counts.end(), 0.0f) ==
+            config.numSimulations - 1);
+
+    // the kept graph is copied with every shared node once
+    const Action action =
+        std::max_element(counts.begin(), counts.end()) - counts.begin();
+    const size_t tableSize = graph.getTableSize(0);
+    graph.advance(0, action);
+    REQUIRE(graph.getTableSize(0) > 0);
+    REQUIRE(graph.getTableSize(0) < tableSize);
+    graph.search(evaluate);
+    graph.getVisitCounts(0, counts.data());
+    REQUIRE(std::accumulate(counts.begin(), counts.end(), 0.0f) >=
+            config.numSimulations);
+}
+
+TEST_CASE("EvalCache: the clock keeps the entries that were used") {
+    EvalCache cache(2, 1);
+    const float priors[] = {0.25f, 0.75f};
+    cache.insert(1, priors, 2, 0.5f);
+    cache.insert(2, priors, 1, -0.5f);
+
+    std::vector<float> cached;
+    float value;
+    REQUIRE(cache.lookup(1, cached, value));
+    REQUIRE(cached == std::vector<float>{0.25f, 0.75f});
+    REQUIRE(value == 0.5f);
+
+    // 2 wasn't used since it was added
+    cache.insert(3, priors, 2, 0.0f);
+    REQUIRE(cache.size() == 2);
+    REQUIRE(cache.lookup(1, cached, value));
+    REQUIRE_FALSE(cache.lookup(2, cached, value));
+    REQUIRE(cache.lookup(3, cached, value));
+    REQUIRE(cache.getHits() == 3);
+    REQUIRE(cache.getMisses() == 1);
+}
+
+TEST_CASE("EvalCache: the key covers the past boards") {
+    const Move nf3 = Movegen::create_move(6ull, 21ull, 0);
+    const Move nf6 = Movegen::create_move(62ull, 45ull, 0);
+    const Move nc3 = Movegen::create_move(1ull, 18ull, 0);
+    const Move nc6 = Movegen::create_move(57ull, 42ull, 0);
+    const auto play = [](std::vector<Move> moves) {
+        GameState state;
+        for (const Move move : moves) {
+            applyAction(state, state.status.isWhite
+                                   ? getMoveIndex<true>(move)
+                                   : getMoveIndex<false>(move));
+        }
+        return getEvaluationKey(state);
+    };
+    REQUIRE(play({nf3, nf6, nc3, nc6}) == play({nf3, nf6, nc3, nc6}));
+    REQUIRE(play({nf3, nf6, nc3, nc6}) != play({nc3, nc6, nf3, nf6}));
+}
+
+TEST_CASE("BatchedMcts: a shared cache skips known positions") {
+    MctsConfig config;
+    config.numSimulations = 300;
+    // with one leaf per round a hit changes nothing about the next leaves
+    config.leavesPerRound = 1;
+    size_t evaluated = 0;
+    const MctsEvaluator evaluate = [&](size_t batchSize, const uint8_t *obs,
+                                       const uint8_t *masks, float *priors,
+                                       float *values) {
+        evaluated += batchSize;
+        uniformEvaluator(batchSize, obs, masks, priors, values);
+    };
+
+    EvalCache cache(1 << 16);
+    BatchedMcts first(1, config, 6);
+    first.setEvalCache(&cache);
+    first.search(evaluate);
+    REQUIRE(evaluated == config.numSimulations);
+    REQUIRE(cache.size() == evaluated);
+
+    // the same search again only finds positions it evaluated already
+    evaluated = 0;
+    BatchedMcts second(1, config, 6);
+    second.setEvalCache(&cache);
+    second.search(evaluate);
+    REQUIRE(evaluated == 0);
+    REQUIRE(cache.getHits() == config.numSimulations);
+
+    std::vector<float> firstCounts(ACTION_SPACE_SIZE);
+    std::vector<float> secondCounts(ACTION_SPACE_SIZE);
+    first.getVisitCounts(0, firstCounts.data());
+    second.getVisitCounts(0, secondCounts.data());
+    REQUIRE(firstCounts == secondCounts);
+
+    // a larger search with hits and misses in the same round only sends the
+    // misses to the network, a hit doesn't take a slot of the batch
+    config.numSimulations = 600;
+    config.leavesPerRound = 8;
+    evaluated = 0;
+    const uint64_t hitsBefore = cache.getHits();
+    BatchedMcts third(2, config, 6);
+    third.setEvalCache(&cache);
+    third.search([&](size_t batchSize, const uint8_t *obs,
+                     const uint8_t *masks, float *priors, float *values) {
+        for (size_t i = 0; i < batchSize; i++) {
+            const uint8_t *mask = masks + i * ACTION_SPACE_SIZE;
+            REQUIRE(std::count(mask, mask + ACTION_SPACE_SIZE, 1) > 0);
+        }
+        evaluate(batchSize, obs, masks, priors, values);
+    });
+    const uint64_t hits = cache.getHits() - hitsBefore;
+    REQUIRE(hits > 0);
+    REQUIRE(evaluated > 0);
+    REQUIRE(evaluated + hits == 2 * config.numSimulations);
+}
+
+TEST_CASE("BatchedMcts: the network gets the observation of the leaf") {
+    const std::string fen =
+        "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1";
+    MctsConfig config;
+    config.numSimulations = 1;
+    BatchedMcts mcts(1, config, 1);
+    mcts.reset(0, parseFen(fen));
+
+    std::vector<uint8_t> expectedObs(OBSERVATION_SPACE_SIZE);
+    std::vector<uint8_t> expectedMask(ACTION_SPACE_SIZE);
+    ChessGameEnv(fen).observeInto(expectedObs.data(), expectedMask.data());
+    mcts.search([&](size_t batchSize, const uint8_t *obs, const uint8_t *masks,
+                    float *priors, float *values) {
+        REQUIRE(batchSize == 1);
+        REQUIRE(std::equal(expectedObs.begin(), expectedObs.end(), obs));
+        REQUIRE(std::equal(expectedMask.begin(), expectedMask.end(), masks));
+        uniformEvaluator(batchSize, obs, masks, priors, values);
+    });
+}
+
+TEST_CASE("Arena: reset hands out the same memory again") {
+    Arena arena(256);
+    uint8_t *byte = arena.allocate<uint8_t>();
+    uint64_t *numbers = arena.allocate<uint64_t>(4);
+    REQUIRE(reinterpret_cast<uintptr_t>(numbers) % alignof(uint64_t) == 0);
+    REQUIRE(numbers[3] == 0);
+    // larger than a block
+    uint64_t *large = arena.allocate<uint64_t>(100);
+    const size_t capacity = arena.getCapacity();
+
+    arena.reset();
+    REQUIRE(arena.allocate<uint8_t>() == byte);
+    REQUIRE(arena.allocate<uint64_t>(4) == numbers);
+    REQUIRE(arena.allocate<uint64_t>(100) == large);
+    REQUIRE(arena.getCapacity() == capacity);
+}
+
+TEST_CASE("BatchedMcts: searching again after a reset doesn't allocate") {
+    MctsConfig config;
+    config.numSimulations = 800;
+    BatchedMcts mcts(1, config, 5);
+    mcts.search(uniformEvaluator);
+    const size_t capacity = mcts.getArenaCapacity(0);
+    mcts.reset(0, GameState());
+    mcts.search(uniformEvaluator);
+    REQUIRE(mcts.getArenaCapacity(0) == capacity);
+}
+
+TEST_CASE("ParallelMcts: finds the mate in one with several threads") {
+    MctsConfig config;
+    config.numSimulations = 400;
+    config.leavesPerRound = 16;
+    config.dirichletEpsilon = 0.0f;
+    ParallelMcts mcts(config, 4, 1);
+    mcts.reset(parseFen("6k1/5ppp/8/8/8/8/8/R5K1 w - - 0 1"));
+
+    size_t evaluated = 0;
+    mcts.search([&](size_t batchSize, const uint8_t *obs, const uint8_t *masks,
+                    float *priors, float *values) {
+        REQUIRE(batchSize <= config.leavesPerRound);
+        evaluated += batchSize;
+        uniformEvaluator(batchSize, obs, masks, priors, values);
+    });
+
+    std::vector<float> counts(ACTION_SPACE_SIZE);
+    mcts.getVisitCounts(counts.data());
+    const Action mate =
+        getMoveIndex<true>(Movegen::create_move(0ull, 56ull, 0));
+    REQUIRE(std::max_element(counts.begin(), counts.end()) - counts.begin() ==
+            static_cast<int64_t>(mate));
+    REQUIRE(std::accumulate(counts.begin(), counts.end(), 0.0f) ==
+            config.numSimulations - 1);
+    REQUIRE(evaluated < config.numSimulations);
+    REQUIRE(mcts.getRootValue() > 0.5f);
+
+    // the kept subtree has the visits of the played move
+    const float childVisits = counts[mate];
+    mcts.advance(mate);
+    REQUIRE(mcts.getRootValue() == Approx(-1.0f));
+    mcts.getVisitCounts(counts.data());
+    REQUIRE(std::accumulate(counts.begin(), counts.end(), 0.0f) == 0.0f);
+    REQUIRE(childVisits > 0.0f);
+}
+
+TEST_CASE("ParallelMcts: every simulation is counted from the start position") {
+    MctsConfig config;
+    config.numSimulations = 500;
+    config.leavesPerRound = 32;
+    ParallelMcts mcts(config, 4, 2);
+    mcts.search(uniformEvaluator);
+    std::vector<float> counts(ACTION_SPACE_SIZE);
+    mcts.getVisitCounts(counts.data());
+    REQUIRE(std::accumulate(counts.begin(), counts.end(), 0.0f) ==
+            config.numSimulations - 1);
+    mcts.search(uniformEvaluator);
+    mcts.getVisitCounts(counts.data());
+    REQUIRE(std::accumulate(counts.begin(), counts.end(), 0.0f) ==
+            2 * config.numSimulations - 1);
+}
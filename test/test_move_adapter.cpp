@@ -1,6 +1,8 @@
 #define CATCH_CONFIG_MAIN
 #include <catch2/catch.hpp>
 
+#include <algorithm>
+
 #include "types.hpp"
 #include "moves.hpp"
 #include "game_env.hpp"
@@ -208,3 +210,29 @@ TEST_CASE("Move conversion: white pawn moves promotion") {
     REQUIRE(ai.targetSquare == targetSquare);
     REQUIRE(flagsC == flags);
 }
+
+TEST_CASE("Move conversion: action mask matches the legal moves") {
+    const std::string fen = GENERATE(
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+        "r2q1rk1/pP1p2pp/Q4n2/bbp1p3/Np6/1B3NBn/pPPP1PPP/R3K2R b KQ - 0 1");
+    const GameState state = parseFen(fen);
+    const Moves moves = Movegen::getLegalMoves(state);
+
+    std::vector<bool> mask;
+    if (state.status.isWhite) {
+        mask = generateLegalActionMask<true>(state);
+    } else {
+        mask = generateLegalActionMask<false>(state);
+    }
+
+    REQUIRE(std::count(mask.begin(), mask.end(), true) == moves.size());
+    for (const Move move : moves) {
+        const Action action = state.status.isWhite ? getMoveIndex<true>(move)
+                                                   : getMoveIndex<false>(move);
+        const ActionInfo ai = state.status.isWhite ? parseAction<true>(action)
+                                                   : parseAction<false>(action);
+        REQUIRE(mask[action]);
+        REQUIRE(ai.sourceSquare == (move & 0b111111));
+        REQUIRE(ai.targetSquare == ((move >> 6) & 0b111111));
+    }
+}